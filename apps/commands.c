@@ -20,7 +20,11 @@
 #include <drivers/video.h>
 #include <fs/vfs.h>
 #include <hal/hal.h>
+#include <hal/latency.h>
 #include <lib/string.h>
+#include <lib/math.h>
+#include <mm/page_cache.h>
+#include <fs/buffer.h>
 #include <proc/proc.h>
 #include <proc/sched.h>
 
@@ -85,7 +89,7 @@ void console_exec(char *buf) {
     } else if(strcmp(buf, "hoho") == 0) {
         console_print("hoho\n");
     } else if(strcmp(buf, "help") == 0) {
-        console_print("Help:\nhoho - prints hoho\nhelp - shows help\nmeminfo - prints RAM info\ncpuinfo - shows CPU info\nls - shows filesystem devices\nread - reads a file\nstart - starts a program\nclear - clears the screen\nhalt - shuts down\nreboot - reboots the pc\n");
+        console_print("Help:\nhoho - prints hoho\nhelp - shows help\nmeminfo - prints RAM info\ncpuinfo - shows CPU info\nls - shows filesystem devices\ntop - shows where the CPU time goes\nlatency - longest interrupts and preemption off windows, latency reset clears them\nread - reads a file\nstart - starts a program\nclear - clears the screen\nhalt - shuts down\nreboot - reboots the pc\n");
     } else if(strcmp(buf, "meminfo") == 0) {
         print_meminfo();
     } else if(strcmp(buf, "cpuinfo") == 0) {
@@ -100,6 +104,10 @@ void console_exec(char *buf) {
         clear();
     } else if(strcmp(buf, "proc") == 0) {
         print_procs();
+    } else if(strcmp(buf, "top") == 0) {
+        console_top();
+    } else if(strncmp(buf, "latency", 7) == 0) {
+        console_latency(buf);
     } else if(strcmp(buf, "halt") == 0) {
         console_print("Shutting down\n");
         halt();
@@ -151,8 +159,8 @@ void console_start(char *dir, char *command) {
     
     int procn = start_proc(senddir, arguments);
     if(procn != PROC_STOPPED) {
-        while(proc_state(procn) != PROC_STOPPED);
-        remove_proc(procn);
+        int status;
+        waitpid_sys(procn, &status);
         console_print("\n");
     }
 }
@@ -228,10 +236,10 @@ char *console_pwd() {
 }
 
 char *console_pwd_user() {
-    process_t *cur = get_cur_proc();
-    if(cur && cur->thread_list) {
+    thread_t *cur = get_cur_thread();
+    if(cur) {
         char *dir = console_pwd();
-        char *pwd_dir = (char *) umalloc(strlen(dir), (vmm_addr_t *) cur->thread_list->heap);
+        char *pwd_dir = (char *) umalloc(strlen(dir), (vmm_addr_t *) cur->heap);
         strcpy(pwd_dir, dir);
         return pwd_dir;
     }
@@ -271,9 +279,85 @@ void print_file(file *f) {
 void print_meminfo() {
     console_print("Total mem: %d MB\nFree mem: %d MB\n", get_mem_size() / 1024, (get_max_blocks() - get_used_blocks()) * 4 / 1024);
     console_print("Heap size: %d KB Free heap: %d KB\n", get_heap_size() / 1024, (get_heap_size() - get_used_heap()) / 1024);
+    console_print("Shared program pages: %d\n", page_cache_pages());
+    console_print("Cached sectors: %d\n", buffer_count());
     console_print("cr0: %x cr2: %x cr3: %x\n", get_cr0(), get_cr2(), get_pdbr());
 }
 
+#define TOP_MAX_THREADS     64
+#define TOP_INTERVAL_MS     1000
+
+static uint32_t ns_to_ms(uint64_t ns) {
+    uint32_t rem;
+    return (uint32_t) div64(ns, 1000000, &rem);
+}
+
+/**
+ * Shows where the CPU time went in the last second for every thread,
+ * until a key is pressed. LOAD is the percentage of one CPU.
+ */
+void console_top() {
+    struct sched_stats *old = (struct sched_stats *) kmalloc(sizeof(struct sched_stats) * TOP_MAX_THREADS);
+    struct sched_stats *cur = (struct sched_stats *) kmalloc(sizeof(struct sched_stats) * TOP_MAX_THREADS);
+    if((old == NULL) || (cur == NULL)) {
+        console_print("top: out of memory\n");
+        if(old)
+            kfree(old);
+        if(cur)
+            kfree(cur);
+        return;
+    }
+    
+    int nold = sched_getstats(old, TOP_MAX_THREADS);
+    uint64_t idle_old = sched_idle_time();
+    uint64_t time_old = clock_now();
+    
+    keyboard_invalidate_lastkey();
+    while(!keyboard_get_lastkey()) {
+        sleep(TOP_INTERVAL_MS);
+        
+        int n = sched_getstats(cur, TOP_MAX_THREADS);
+        uint64_t idle = sched_idle_time();
+        uint64_t now = clock_now();
+        uint32_t interval = ns_to_ms(now - time_old);
+        if(interval == 0)
+            interval = 1;
+        
+        clear();
+        console_print("CPUs: %d threads: %d idle: %d percent\n", smp_ncpus(), n, ns_to_ms(idle - idle_old) * 100 / (interval * smp_ncpus()));
+        console_print("PID NAME CPU PRI LOAD USER(ms) SYS(ms) WAIT(ms) VCSW IVCSW\n");
+        for(int i = 0; i < n; i++) {
+            // Time used since the previous refresh, new threads count from 0
+            uint64_t used = cur[i].user_time + cur[i].kernel_time;
+            for(int j = 0; j < nold; j++) {
+                if(old[j].pid == cur[i].pid) {
+                    used -= old[j].user_time + old[j].kernel_time;
+                    break;
+                }
+            }
+            console_print("%d %s %d ", cur[i].pid, cur[i].name, cur[i].last_cpu);
+            // Real-time threads show their priority, the others their nice value
+            if(cur[i].policy != SCHED_OTHER)
+                console_print("rt%d ", cur[i].rt_priority);
+            else
+                console_print("%d ", cur[i].nice);
+            console_print("%d %d %d %d %d %d\n", ns_to_ms(used) * 100 / interval,
+                          ns_to_ms(cur[i].user_time), ns_to_ms(cur[i].kernel_time), ns_to_ms(cur[i].wait_time), cur[i].nvcsw, cur[i].nivcsw);
+        }
+        
+        struct sched_stats *swap = old;
+        old = cur;
+        cur = swap;
+        nold = n;
+        idle_old = idle;
+        time_old = now;
+    }
+    keyboard_invalidate_lastkey();
+    
+    kfree(old);
+    kfree(cur);
+}
+
 /**
  * Returns the next argument
  */
@@ -288,3 +372,28 @@ char *get_argument(char *command, int n) {
     }
     return command;
 }
+
+/**
+ * Prints the longest windows with the interrupts or the preemption
+ * disabled and where they were opened and closed
+ */
+void console_latency(char *command) {
+    char *arg = get_argument(command, 1);
+    if((arg != NULL) && (strcmp(arg, "reset") == 0)) {
+        latency_reset();
+        return;
+    }
+    
+    struct latency_window window;
+    uint32_t rem;
+    char *names[LATENCY_KINDS] = { "interrupts off", "preemption off" };
+    for(int i = 0; i < LATENCY_KINDS; i++) {
+        latency_get(i, &window);
+        if(window.cpu == -1) {
+            console_print("%s: nothing recorded\n", names[i]);
+            continue;
+        }
+        console_print("%s: %d us on CPU %d, from 0x%x to 0x%x\n", names[i], (uint32_t) div64(window.max, 1000, &rem), window.cpu,
+                      (uint32_t) window.start_site, (uint32_t) window.end_site);
+    }
+}
@@ -48,10 +48,7 @@ void console_run() {
     printk("%s $  ", user);
     int buffer_counter = 0;
     while(1) {
-        c = keyboard_get_lastkey();
-        if(c == NULL)
-            continue;
-        keyboard_invalidate_lastkey();
+        c = getchar();
         if(character_check(c)) {
             buffer[buffer_counter++] = c;
         } else if(c == '\b') { // Backspace
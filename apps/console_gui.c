@@ -24,11 +24,13 @@
 #include <drivers/video.h>
 #include <proc/proc.h>
 #include <proc/sched.h>
+#include <proc/mutex.h>
 
 char *user;
 
 window_t *window;
 text_area_t *text_area;
+static mutex_t text_area_lock = MUTEX_INIT;
 
 /**
  * Sets up the console
@@ -55,10 +57,7 @@ void console_run_gui() {
     console_print("%s  $ ", user);
     int buffer_counter = 0;
     while(1) {
-        c = keyboard_get_lastkey();
-        if(c == NULL)
-            continue;
-        keyboard_invalidate_lastkey();
+        c = getchar();
         if(character_check(c)) {
             buffer[buffer_counter++] = c;
         } else if(c == '\b') { // Backspace
@@ -81,5 +80,7 @@ void console_run_gui() {
 }
 
 void console_gui_print(char *str) {
+    mutex_lock(&text_area_lock);
     text_area_append(text_area, str);
+    mutex_unlock(&text_area_lock);
 }
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <sync.h>
 
 int main() {
     pid_t pid;
@@ -14,33 +15,30 @@ int main() {
     return 0;
 }
 /*
+umutex_t lock = UMUTEX_INIT;
+
 int main() {
     pid_t pid;
-    int sema = 0;
     pid = fork();
     if(pid == 0) {
         char c = 'a';
         while(1) {
-            if(!sema) {
-                sema = 1;
-                printf("%c", c++);
-                if(c > 'z')
-                    c = 'a';
-                sema = 0;
-            }
+            umutex_lock(&lock);
+            printf("%c", c++);
+            if(c > 'z')
+                c = 'a';
+            umutex_unlock(&lock);
         }
     } else {
         if(pid < 0)
             return 1;
         char c = '0';
         while(1) {
-            if(!sema) {
-                sema = 1;
-                printf("%c", c++);
-                if(c > '9')
-                    c = '0';
-                sema = 0;
-            }
+            umutex_lock(&lock);
+            printf("%c", c++);
+            if(c > '9')
+                c = '0';
+            umutex_unlock(&lock);
         }
     }
     return 0;
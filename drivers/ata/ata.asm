@@ -14,15 +14,32 @@
 ;  limitations under the License.
 ;
 
-extern ata_irq_done
+extern ata_irq
 
 global ata_int
 ata_int:
     pushad
-    inc byte [ata_irq_done]
+    push gs
+    push fs
+    push es
+    push ds
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    call ata_irq
+    
     mov al, 0x20
     out 0xA0, al
     out 0x20, al
+    
+    pop ds
+    pop es
+    pop fs
+    pop gs
     popad
     iretd
 
@@ -19,15 +19,18 @@
 #include <drivers/video.h>
 #include <lib/string.h>
 #include <fs/fat.h>
+#include <proc/wait.h>
 
 static ata_drives_t ata_info;
-uint8_t ata_irq_done = 0;
+static volatile uint8_t ata_irq_done = 0;
+static wait_queue_t ata_queue;
 
 static device_t dev_info[4];
 
 extern void ata_int();
 
 void ata_init() {
+    wait_queue_init(&ata_queue);
     install_ir(46, 0x80 | 0x0E, 0x8, &ata_int);
     install_ir(47, 0x80 | 0x0E, 0x8, &ata_int);
     ata_info_fill(&ata_info.primary_master, 1, ATA_PRIMARY_DATA, ATA_PRIMARY_ERR, ATA_PRIMARY_SECTORS, ATA_PRIMARY_LBA_LOW, ATA_PRIMARY_LBA_MID, ATA_PRIMARY_LBA_HIGH, ATA_PRIMARY_DRIVE_SEL, ATA_PRIMARY_STATUS, ATA_PRIMARY_IRQ);
@@ -51,8 +54,19 @@ void ata_init() {
     }
 }
 
+/**
+ * Called by ata_int when the drive raises its interrupt
+ */
+void ata_irq() {
+    ata_irq_done = 1;
+    wake_up_all(&ata_queue);
+}
+
+/**
+ * Blocks until the drive raises its interrupt
+ */
 void ata_wait_for_irq() {
-    while(ata_irq_done == 0);
+    wait_event(&ata_queue, ata_irq_done != 0);
     ata_irq_done = 0;
 }
 
@@ -133,25 +147,25 @@ void delay_400ns() {
         inportb(ata_info.cur_hdd.status_reg);
 }
 
-char *ata_read_sector(int lba) {
-    char *buf = (char *) kmalloc(512);
+int ata_read_sector(int lba, char *buf) {
     outportb(ata_info.cur_hdd.sel_reg, 0xE0 | ((lba >> 24) & 0x0F)); // maybe or with (ata_info.cur_hdd.type << 4)
     outportb(ata_info.cur_hdd.err_reg, 0x00);
     outportb(ata_info.cur_hdd.sectors_reg, (uint8_t) 1);
     outportb(ata_info.cur_hdd.lba_low_reg, (uint8_t) lba);
     outportb(ata_info.cur_hdd.lba_mid_reg, (uint8_t) (lba >> 8));
     outportb(ata_info.cur_hdd.lba_high_reg, (uint8_t) (lba >> 16));
+    ata_irq_done = 0;
     outportb(ata_info.cur_hdd.status_reg, 0x20);
-    //ata_wait_for_irq();
+    ata_wait_for_irq();
     delay_400ns();
     
-    while(!(inportb(ata_info.cur_hdd.data_reg) & 0x08));
+    while(!(inportb(ata_info.cur_hdd.status_reg) & 0x08));
     
     for(int i = 0; i < 256; i++) {
         uint16_t tmp = inportw(ata_info.cur_hdd.data_reg);
         *(uint16_t *) (buf + i * 2) = tmp;
     }
     delay_400ns();
-    return buf;
+    return 1;
 }
 
@@ -20,16 +20,17 @@
 #include <drivers/video.h>
 #include <lib/string.h>
 #include <fs/fat.h>
+#include <proc/wait.h>
 
 #define FLOPPY_DMA_LEN 0x4800
 #define FLOPPY_DMA_CHANNEL 2
 
-uint8_t floppy_irq_done = 0;
+static volatile uint8_t floppy_irq_done = 0;
+static wait_queue_t floppy_queue;
 int cur_drive = 0;
 static device_t dev_info[4];
 
 static const char floppy_dmabuf[FLOPPY_DMA_LEN] __attribute__((aligned(0x8000)));
-uint32_t *dma_buffer = (uint32_t *) &floppy_dmabuf;
 
 static char *drive_types[8] = {
     "none",
@@ -53,6 +54,7 @@ static const char *status[] = {
 extern void floppy_int();
 
 void floppy_init() {
+    wait_queue_init(&floppy_queue);
     install_ir(38, 0x80 | 0x0E, 0x8, &floppy_int);
     int ndrives = floppy_detect_drives();
     if(ndrives > 0) {
@@ -61,8 +63,19 @@ void floppy_init() {
     }
 }
 
+/**
+ * Called by floppy_int when the controller raises its interrupt
+ */
+void floppy_irq() {
+    floppy_irq_done = 1;
+    wake_up_all(&floppy_queue);
+}
+
+/**
+ * Blocks until the controller raises its interrupt
+ */
 void floppy_wait_irq() {
-    while(floppy_irq_done == 0);
+    wait_event(&floppy_queue, floppy_irq_done != 0);
     floppy_irq_done = 0;
 }
 
@@ -141,19 +154,20 @@ void floppy_read_sector_imp(uint8_t head, uint8_t track, uint8_t sector) {
     }
 }
 
-char *floppy_read_sector(int lba) {
+int floppy_read_sector(int lba, char *buf) {
     if(cur_drive > 3)
-        return (char *) -1;
+        return -1;
     int head = 0, track = 0, sector = 1;
     floppy_lba_to_chs(lba, &head, &track, &sector);
     floppy_control_motor(1);
     if(floppy_seek((uint8_t) track, (uint8_t) head) != 0) {
         floppy_control_motor(0);
-        return 0;
+        return -1;
     }
     floppy_read_sector_imp((uint8_t) head, (uint8_t) track, (uint8_t) sector);
     floppy_control_motor(0);
-    return (char *) &floppy_dmabuf;
+    memcpy(buf, (void *) &floppy_dmabuf, 512);
+    return 1;
 }
 
 int floppy_write_sector_imp(uint8_t head, uint8_t track, uint8_t sector) {
@@ -187,9 +201,10 @@ int floppy_write_sector_imp(uint8_t head, uint8_t track, uint8_t sector) {
     return 1;
 }
 
-int floppy_write_sector(int lba) {
+int floppy_write_sector(int lba, char *buf) {
     if(cur_drive > 3)
         return -1;
+    memcpy((void *) &floppy_dmabuf, buf, 512);
     int head = 0, track = 0, sector = 1;
     floppy_lba_to_chs(lba, &head, &track, &sector);
     floppy_control_motor(1);
@@ -14,14 +14,31 @@
 ;  limitations under the License.
 ;
 
-extern floppy_irq_done
+extern floppy_irq
 
 global floppy_int
 floppy_int:
     pushad
-    inc byte [floppy_irq_done]
+    push gs
+    push fs
+    push es
+    push ds
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    call floppy_irq
+    
     mov al, 0x20
     out 0x20, al
+    
+    pop ds
+    pop es
+    pop fs
+    pop gs
     popad
     iretd
 
@@ -15,6 +15,7 @@
  */
 
 #include <drivers/io.h>
+#include <hal/latency.h>
 
 uint8_t inportb(uint16_t port) {
     uint8_t ret;
@@ -44,3 +45,28 @@ void disable_int() {
     asm volatile("cli");
 }
 
+/* Disables interrupts and returns the previous eflags, site is where the window starts */
+int disable_int_save_at(void *site) {
+    int flags;
+    asm volatile("pushf; pop %0; cli" : "=r" (flags) : : "memory");
+    if(flags & 0x200)
+        latency_start(LATENCY_IRQ, site);
+    return flags;
+}
+
+/* Disables interrupts and returns the previous eflags */
+int disable_int_save() {
+    return disable_int_save_at(__builtin_return_address(0));
+}
+
+/* Enables interrupts again only if they were enabled in the saved eflags */
+void restore_int_at(int flags, void *site) {
+    if(flags & 0x200) {
+        latency_end(LATENCY_IRQ, site);
+        enable_int();
+    }
+}
+
+void restore_int(int flags) {
+    restore_int_at(flags, __builtin_return_address(0));
+}
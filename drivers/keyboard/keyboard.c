@@ -19,6 +19,7 @@
 #include <drivers/video.h>
 #include <drivers/io.h>
 #include <console.h>
+#include <proc/wait.h>
 
 enum KBD_PORTS {
 	KBD_CHECK = 0x64,
@@ -26,6 +27,8 @@ enum KBD_PORTS {
 };
 
 static uint8_t lastkey = 0;
+static wait_queue_t keyboard_queue;
+static spinlock_t keyboard_lock = SPINLOCK_INIT;
 /*
 static uint8_t caps_lock = 0;
 static uint8_t num_pad = 0;
@@ -38,14 +41,21 @@ static uint8_t alt = 0;*/
 extern void keyboard_int();
 
 void keyboard_init() {
+    wait_queue_init(&keyboard_queue);
     install_ir(33, 0x80 | 0x0E, 0x8, &keyboard_int);
     outportb(KBD_CHECK, 0xAE);
 }
 
 void keyboard_read_key() {
-    lastkey = 0;
     if(inportb(KBD_CHECK) & 1) {
-        lastkey = keyboard_to_ascii(inportb(KBD_IN));
+        // Key releases don't overwrite a key that wasn't read yet
+        uint8_t key = keyboard_to_ascii(inportb(KBD_IN));
+        if(key) {
+            spin_lock(&keyboard_lock);
+            lastkey = key;
+            spin_unlock(&keyboard_lock);
+            wake_up_all(&keyboard_queue);
+        }
 	}
 }
 
@@ -57,6 +67,17 @@ void keyboard_invalidate_lastkey() {
     lastkey = NULL;
 }
 
+/**
+ * Reads and invalidates the last key, only one of the readers gets it
+ */
+static char keyboard_take_key() {
+    int flags = spin_lock_irqsave(&keyboard_lock);
+    char c = lastkey;
+    lastkey = NULL;
+    spin_unlock_irqrestore(&keyboard_lock, flags);
+    return c;
+}
+
 static char* qwertzuiop = "qwertzuiop"; // 0x10-0x1c
 static char* asdfghjkl = "asdfghjkl";
 static char* yxcvbnm = "yxcvbnm";
@@ -89,29 +110,21 @@ void keyboard_set_leds(int num, int capslock, int scroll) {
     outportb(KBD_IN, cmd);
 }
 
+/**
+ * Blocks until a key is pressed
+ */
 char getchar() {
-    asm volatile("sti");
-    char c = NULL;
-    while(1) {
-        c = keyboard_get_lastkey();
-        if(c == NULL)
-            continue;
-        keyboard_invalidate_lastkey();
-        return c;
-    }
+    char c;
+    wait_event(&keyboard_queue, (c = keyboard_take_key()) != NULL);
+    return c;
 }
 
 void gets(char *str) {
     int count = 0;
     char c;
     
-    asm volatile("sti");
-    sched_state(0);
     while(1) {
-        c = keyboard_get_lastkey();
-        if(c == NULL)
-            continue;
-        keyboard_invalidate_lastkey();
+        c = getchar();
         if(((int) c >= 32) && ((int) c <= 122))
             str[count++] = c;
         else if(c == '\b')
@@ -123,6 +136,5 @@ void gets(char *str) {
             break;
         }
     }
-    sched_state(1);
 }
 
@@ -20,9 +20,12 @@
 #include <graphics.h>
 #include <gui/window.h>
 #include <gui/font.h>
+#include <proc/spinlock.h>
+#include <proc/sched.h>
 
 static int x;
 static int y;
+static spinlock_t video_lock = SPINLOCK_INIT;
 struct video_mem vram;
 struct vbe_mem vbemem;
 
@@ -47,12 +50,14 @@ void printk(char *buffer, ...) {
 
 void printk_string(char *buffer) {
     int i = 0;
+    int flags = spin_lock_irqsave(&video_lock);
     
     check();
     
     while(buffer[i] != '\0') {
         switch(buffer[i]) {
             case '\0':
+                spin_unlock_irqrestore(&video_lock, flags);
                 return;
             case '\b':
                 vram.ram[(y * vram.width) + --x] = (uint16_t) 3872;
@@ -74,6 +79,7 @@ void printk_string(char *buffer) {
                 break;
         }
     }
+    spin_unlock_irqrestore(&video_lock, flags);
 }
 
 void check() {
@@ -97,10 +103,12 @@ void scroll() {
 }
 
 void clear() {
+    int flags = spin_lock_irqsave(&video_lock);
     x = y = 0;
     for(int i = 0; i < vram.heigth * vram.width; i++) {
         *(vram.ram + i) = (uint16_t) 3872;
     }
+    spin_unlock_irqrestore(&video_lock, flags);
 }
 
 void vbe_init(multiboot_info_t *info) {
@@ -132,10 +140,15 @@ void vbe_init(multiboot_info_t *info) {
     }
 }
 
+/**
+ * Compositor thread, it runs as a real-time thread so it sleeps between
+ * frames to leave the CPU to the others
+ */
 void refresh_screen() {
     for(;;) {
         paint_desktop();
         memcpy(vbemem.mem, vbemem.buffer, vbemem.buffer_size);
+        sched_sleep(VIDEO_FRAME_NS);
     }
 }
 
@@ -0,0 +1,65 @@
+;
+;  Copyright 2016 Davide Pianca
+;
+;  Licensed under the Apache License, Version 2.0 (the "License");
+;  you may not use this file except in compliance with the License.
+;  You may obtain a copy of the License at
+;
+;      http://www.apache.org/licenses/LICENSE-2.0
+;
+;  Unless required by applicable law or agreed to in writing, software
+;  distributed under the License is distributed on an "AS IS" BASIS,
+;  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+;  See the License for the specific language governing permissions and
+;  limitations under the License.
+;
+
+extern timer_interrupt
+
+global apic_timer_int
+apic_timer_int:
+
+    ; push registers
+    push eax
+    push ebx
+    push ecx
+    push edx
+    push esi
+    push edi
+    push ebp
+    push ds
+    push es
+    push fs
+    push gs
+    
+    mov ebx, esp            ; save stack pointer
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    
+    push ebx
+    call timer_interrupt    ; acknowledge, switch task if needed
+    
+    mov esp, eax            ; change stack pointer
+    
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    
+    pop ebp
+    pop edi
+    pop esi
+    pop edx
+    pop ecx
+    pop ebx
+    pop eax
+    iretd
+
+; Spurious interrupts don't need an EOI
+global apic_spurious_int
+apic_spurious_int:
+    iretd
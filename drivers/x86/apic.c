@@ -0,0 +1,124 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <drivers/apic.h>
+#include <hal/hal.h>
+#include <mm/memory.h>
+
+static volatile uint32_t *apic_regs = NULL;
+
+extern void apic_timer_int();
+extern void apic_spurious_int();
+
+uint32_t apic_read(uint32_t reg) {
+    return apic_regs[reg >> 2];
+}
+
+void apic_write(uint32_t reg, uint32_t val) {
+    apic_regs[reg >> 2] = val;
+}
+
+void apic_eoi() {
+    apic_write(APIC_REG_EOI, 0);
+}
+
+/**
+ * Maps and enables the local APIC, returns 0 if the CPU doesn't have one
+ */
+int apic_init() {
+    if(!cpu_has_feature(CPUID_FEAT_EDX_APIC | CPUID_FEAT_EDX_MSR))
+        return 0;
+    
+    uint32_t base = (uint32_t) cpu_rdmsr(APIC_BASE_MSR) & APIC_BASE_ADDR_MASK;
+    if(!vmm_map_phys(get_kern_directory(), base, base, PAGE_PRESENT | PAGE_RW | PAGE_CACHE_DISABLE))
+        return 0;
+    apic_regs = (volatile uint32_t *) base;
+    
+    install_ir(APIC_TIMER_INT, 0x80 | 0x0E, 0x8, &apic_timer_int);
+    install_ir(APIC_SPURIOUS_INT, 0x80 | 0x0E, 0x8, &apic_spurious_int);
+    
+    apic_enable();
+    return 1;
+}
+
+/**
+ * Enables the local APIC of the calling CPU, the registers are already
+ * mapped
+ */
+void apic_enable() {
+    uint32_t base = (uint32_t) apic_regs;
+    cpu_wrmsr(APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+    apic_write(APIC_REG_TPR, 0);
+    apic_write(APIC_REG_SPURIOUS, APIC_SPURIOUS_INT | APIC_SOFTWARE_ENABLE);
+}
+
+int apic_available() {
+    return apic_regs != NULL;
+}
+
+uint8_t apic_id() {
+    return apic_read(APIC_REG_ID) >> 24;
+}
+
+/**
+ * Sends an interrupt command to another CPU and waits for its delivery
+ */
+void apic_send_ipi(uint8_t apic_id, uint32_t cmd) {
+    int flags = disable_int_save();
+    apic_write(APIC_REG_ICR_HIGH, (uint32_t) apic_id << 24);
+    apic_write(APIC_REG_ICR_LOW, cmd);
+    while(apic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING);
+    restore_int(flags);
+}
+
+/**
+ * Puts the timer in one-shot mode, stopped
+ */
+void apic_timer_setup() {
+    apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIV_16);
+    apic_write(APIC_REG_TIMER_INIT, 0);
+    apic_write(APIC_REG_LVT_TIMER, APIC_TIMER_INT | APIC_TIMER_ONESHOT);
+}
+
+/**
+ * Measures the timer counts per second against the PIT and leaves the
+ * timer in one-shot mode, stopped
+ */
+uint32_t apic_timer_calibrate() {
+    apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIV_16);
+    apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+    
+    apic_write(APIC_REG_TIMER_INIT, 0xFFFFFFFF);
+    pit_wait(APIC_CALIBRATE_MS);
+    uint32_t elapsed = 0xFFFFFFFF - apic_read(APIC_REG_TIMER_CUR);
+    
+    apic_timer_setup();
+    return elapsed * (1000 / APIC_CALIBRATE_MS);
+}
+
+/**
+ * Raises APIC_TIMER_INT once after count timer counts
+ */
+void apic_timer_oneshot(uint32_t count) {
+    apic_write(APIC_REG_TIMER_INIT, count);
+}
+
+/**
+ * Counts left before the timer fires, 0 if it already did
+ */
+uint32_t apic_timer_current() {
+    return apic_read(APIC_REG_TIMER_CUR);
+}
@@ -18,8 +18,6 @@
 #include <mm/memory.h>
 #include <lib/string.h>
 
-#define cpuid(in, a, b, c, d) asm volatile("cpuid": "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (in));
-
 char *get_cpu_vendor() {
     int eax, ebx, ecx, edx;
     char *v = (char *) kmalloc(sizeof(char) * 32);
@@ -37,3 +35,21 @@ char *get_cpu_vendor() {
 	return v;
 }
 
+/**
+ * Checks the standard feature flags returned in edx by cpuid
+ */
+int cpu_has_feature(uint32_t edx_mask) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, eax, ebx, ecx, edx);
+    return (edx & edx_mask) == edx_mask;
+}
+
+uint64_t cpu_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "a" ((uint32_t) value), "d" ((uint32_t) (value >> 32)), "c" (msr));
+}
@@ -62,3 +62,12 @@ void pic_init(uint8_t base0, uint8_t base1) {
     pic_send_data(icw, 1);
 }
 
+/**
+ * Stops the PIC from raising the given interrupt line (0-15)
+ */
+void pic_mask(uint8_t irq) {
+    if(irq < 8)
+        pic_send_data(pic_read_data(0) | (1 << irq), 0);
+    else
+        pic_send_data(pic_read_data(1) | (1 << (irq - 8)), 1);
+}
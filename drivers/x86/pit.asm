@@ -15,7 +15,6 @@
 ;
 
 extern pit_ticks
-extern sched_on
 
 extern schedule
 
@@ -43,18 +42,14 @@ pit_int:
     mov fs, ax
     mov gs, ax
     
-    inc byte [pit_ticks]    ; increment PIT ticks
-    
-    mov eax, 0              ; check if scheduling is on
-    cmp [sched_on], eax
-    je .restore             ; scheduling off, end of interrupt
+    add dword [pit_ticks], 1        ; increment the 64 bit PIT ticks
+    adc dword [pit_ticks + 4], 0
     
     push ebx
-    call schedule           ; switch task
+    call schedule           ; switch task, it returns esp if the scheduler isn't running
     
     mov esp, eax            ; change stack pointer
 
-.restore:
     mov al, 0x20            ; PIC acknowledge
     out 0x20, al
     
@@ -17,19 +17,10 @@
 #include <hal/hal.h>
 #include <proc/sched.h>
 
-uint8_t sched_on = 0;
-uint8_t pit_ticks;
+volatile uint64_t pit_ticks = 0;
 
 extern void pit_int();
 
-void sched_state(int on) {
-    sched_on = on;
-}
-
-int get_sched_state() {
-    return sched_on;
-}
-
 void pit_send_command(uint8_t cmd) {
     outportb(PIT_REG_COMMAND, cmd);
 }
@@ -62,7 +53,7 @@ void pit_start_counter(uint32_t frequency, uint8_t counter, uint8_t mode) {
     if(frequency == 0)
         return;
     
-    uint16_t divisor = (uint16_t) 1193180 / (uint16_t) frequency;
+    uint16_t divisor = (uint16_t) (PIT_BASE_FREQUENCY / frequency);
     
     uint8_t ocw = 0;
     ocw = (ocw & ~PIT_MODE_MASK) | mode;
@@ -71,15 +62,34 @@ void pit_start_counter(uint32_t frequency, uint8_t counter, uint8_t mode) {
     pit_send_command(ocw);
     pit_send_data(divisor & 0xFF, PIT_COUNTER_0);
     pit_send_data((divisor >> 8) & 0xFF, PIT_COUNTER_0);
-    
-    pit_ticks = 0;
 }
 
-int get_tick_count() {
-    return pit_ticks;
+/**
+ * Busy waits on counter 2, which doesn't raise interrupts, up to 50 ms
+ */
+void pit_wait(uint32_t ms) {
+    uint16_t count = (uint16_t) (PIT_BASE_FREQUENCY / 1000 * ms);
+    
+    // Stop the counter and keep the speaker off while loading it
+    uint8_t gate = inportb(PIT_REG_GATE) & ~(PIT_GATE_COUNTER2 | PIT_GATE_SPEAKER);
+    outportb(PIT_REG_GATE, gate);
+    
+    pit_send_command(PIT_COUNTER_2 | PIT_RL_DATA | PIT_MODE_TERMINALCOUNT);
+    pit_send_data(count & 0xFF, PIT_COUNTER_2);
+    pit_send_data((count >> 8) & 0xFF, PIT_COUNTER_2);
+    
+    // Start counting, the output goes high when the count reaches 0
+    outportb(PIT_REG_GATE, gate | PIT_GATE_COUNTER2);
+    while(!(inportb(PIT_REG_GATE) & PIT_GATE_OUT2));
 }
 
-void reset_tick_count() {
-    pit_ticks = 0;
+/**
+ * PIT interrupts since boot, they stop when the APIC timer replaces it
+ */
+uint64_t get_tick_count() {
+    int flags = disable_int_save();
+    uint64_t ticks = pit_ticks;
+    restore_int(flags);
+    return ticks;
 }
 
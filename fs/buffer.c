@@ -0,0 +1,157 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fs/buffer.h>
+#include <mm/kheap.h>
+#include <proc/mutex.h>
+#include <lib/string.h>
+
+static buffer_head_t *buckets[BUFFER_BUCKETS];
+// Most recently used first, the buffers in use are in the list too
+static buffer_head_t *lru_head = NULL;
+static buffer_head_t *lru_tail = NULL;
+static int buffers = 0;
+// The devices can't be used by more than one thread, the lock covers their I/O too
+static mutex_t buffer_lock = MUTEX_INIT;
+
+static uint32_t buffer_hash(device_t *dev, uint32_t lba) {
+    return (dev->id * 31 + lba) % BUFFER_BUCKETS;
+}
+
+static void buffer_lru_remove(buffer_head_t *buf) {
+    if(buf->lru_prec)
+        buf->lru_prec->lru_next = buf->lru_next;
+    else
+        lru_head = buf->lru_next;
+    if(buf->lru_next)
+        buf->lru_next->lru_prec = buf->lru_prec;
+    else
+        lru_tail = buf->lru_prec;
+}
+
+static void buffer_lru_add(buffer_head_t *buf) {
+    buf->lru_prec = NULL;
+    buf->lru_next = lru_head;
+    if(lru_head)
+        lru_head->lru_prec = buf;
+    else
+        lru_tail = buf;
+    lru_head = buf;
+}
+
+static void buffer_hash_remove(buffer_head_t *buf) {
+    buffer_head_t **p = &buckets[buffer_hash(buf->dev, buf->lba)];
+    while(*p != buf)
+        p = &(*p)->hash_next;
+    *p = buf->hash_next;
+}
+
+/**
+ * Returns the buffer of the sector with a new reference, it's taken from
+ * the least recently used ones if it isn't cached. buffer_lock must be held.
+ */
+static buffer_head_t *buffer_lookup(device_t *dev, uint32_t lba) {
+    uint32_t hash = buffer_hash(dev, lba);
+    buffer_head_t *buf = buckets[hash];
+    while(buf && !((buf->dev == dev) && (buf->lba == lba)))
+        buf = buf->hash_next;
+    
+    if(!buf) {
+        if(buffers < BUFFER_MAX) {
+            buf = (buffer_head_t *) kmalloc(sizeof(buffer_head_t));
+            if(buf)
+                buffers++;
+        }
+        if(!buf) {
+            // Reuse the least recently used buffer nobody holds
+            buf = lru_tail;
+            while(buf && buf->refs)
+                buf = buf->lru_prec;
+            if(!buf)
+                return NULL;
+            buffer_hash_remove(buf);
+            buffer_lru_remove(buf);
+        }
+        buf->dev = dev;
+        buf->lba = lba;
+        buf->refs = 0;
+        buf->valid = 0;
+        buf->hash_next = buckets[hash];
+        buckets[hash] = buf;
+    } else {
+        buffer_lru_remove(buf);
+    }
+    buffer_lru_add(buf);
+    buf->refs++;
+    return buf;
+}
+
+/**
+ * Returns the sector with its data, reading it from the device only if
+ * it isn't cached. The buffer has to be given back with buffer_release.
+ */
+buffer_head_t *buffer_read(device_t *dev, uint32_t lba) {
+    mutex_lock(&buffer_lock);
+    buffer_head_t *buf = buffer_lookup(dev, lba);
+    if(buf && !buf->valid) {
+        if(dev->read((int) lba, buf->data) > 0) {
+            buf->valid = 1;
+        } else {
+            buf->refs--;
+            buf = NULL;
+        }
+    }
+    mutex_unlock(&buffer_lock);
+    return buf;
+}
+
+/**
+ * Returns the buffer of a sector that's going to be overwritten, the data
+ * isn't read from the device
+ */
+buffer_head_t *buffer_get(device_t *dev, uint32_t lba) {
+    mutex_lock(&buffer_lock);
+    buffer_head_t *buf = buffer_lookup(dev, lba);
+    mutex_unlock(&buffer_lock);
+    return buf;
+}
+
+/**
+ * Writes the buffer through to its device, returns 0 on error
+ */
+int buffer_write(buffer_head_t *buf) {
+    mutex_lock(&buffer_lock);
+    int ret = buf->dev->write && (buf->dev->write((int) buf->lba, buf->data) > 0);
+    // The device might hold something else now
+    buf->valid = ret;
+    mutex_unlock(&buffer_lock);
+    return ret;
+}
+
+/**
+ * Gives back a buffer from buffer_read or buffer_get, it stays cached
+ */
+void buffer_release(buffer_head_t *buf) {
+    if(!buf)
+        return;
+    mutex_lock(&buffer_lock);
+    buf->refs--;
+    mutex_unlock(&buffer_lock);
+}
+
+int buffer_count() {
+    return buffers;
+}
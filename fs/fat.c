@@ -19,21 +19,22 @@
 #include <fs/fat.h>
 #include <fs/fat_mount.h>
 #include <fs/mbr.h>
+#include <fs/buffer.h>
+#include <mm/page_cache.h>
 #include <drivers/video.h>
 
-#define SECTOR_SIZE 512
-
-extern uint32_t *dma_buffer;
-
-uint8_t FAT[SECTOR_SIZE * 2];
-
-int offset;
+#define SECTOR_SIZE BUFFER_SIZE
 
 void fat_mount(device_t *dev) {
     // Trying with bootsector
-    bootsector_t *bs = (bootsector_t *) dev->read(0);
-    if((bs->ignore[0] != 0xEB) || (bs->ignore[2] != 0x90)) // Not a FAT fs
+    buffer_head_t *buf = buffer_read(dev, 0);
+    if(!buf)
         return;
+    bootsector_t *bs = (bootsector_t *) buf->data;
+    if((bs->ignore[0] != 0xEB) || (bs->ignore[2] != 0x90)) { // Not a FAT fs
+        buffer_release(buf);
+        return;
+    }
     
     // Scan for partitions
     mbr_t *mbr = (mbr_t *) bs;
@@ -47,6 +48,7 @@ void fat_mount(device_t *dev) {
             //bs = (bootsector_t *) dev->read(lba);
             break;
         }
+        buffer_release(buf);
         return;
     }
         
@@ -69,6 +71,7 @@ void fat_mount(device_t *dev) {
         dev->minfo.type = FAT32;
     else
         dev->minfo.type = EXFAT;
+    buffer_release(buf);
 }
 
 void to_dos_file_name(char *name, char *str) {
@@ -121,21 +124,29 @@ uint32_t get_phys_sector(file *f) {
     return 32 + f->current_cluster - 1;
 }
 
-directory_t *fat_get_dir(file *f) {
+/**
+ * Finds the entry of the file in the root directory, buf gets the sector
+ * holding it, which the caller releases
+ */
+directory_t *fat_get_dir(file *f, buffer_head_t **buf) {
     char *dos_file_name = kmalloc(NAME_LEN);
     to_dos_file_name(f->name, dos_file_name);
     device_t *dev = get_dev_by_id(f->dev);
     
     for(int i = 0; i < 14; i++) {
-        directory_t *dir = (directory_t *) dev->read(dev->minfo.root_offset + i); // STUCK HERE WITH FOPEN
+        *buf = buffer_read(dev, dev->minfo.root_offset + i);
+        if(!*buf)
+            break;
+        directory_t *dir = (directory_t *) (*buf)->data;
         for(int j = 0; j < 16; j++, dir++) {
             if(strncmp(dos_file_name, (char *) dir->filename, NAME_LEN) == 0) {
-                offset = i;
                 kfree(dos_file_name);
                 return dir;
             }
         }
+        buffer_release(*buf);
     }
+    *buf = NULL;
     kfree(dos_file_name);
     return NULL;
 }
@@ -151,30 +162,31 @@ int fat_touch(char *name) {
     device_t *dev = get_dev_by_id(f.dev);
     
     for(int i = 0; i < 14; i++) {
-        directory_t *dir = (directory_t *) dev->read(dev->minfo.root_offset + i);
+        buffer_head_t *buf = buffer_read(dev, dev->minfo.root_offset + i);
+        if(!buf)
+            break;
+        directory_t *dir = (directory_t *) buf->data;
         for(int j = 0; j < 16; j++, dir++) {
             if(dir->filename[0] == 0) {
                 strcpy((char *) dir->filename, dos_file_name);
                 dir->file_size = 0;
                 dir->first_cluster = 0;
-                dev->write(dev->minfo.root_offset + i);
+                int ret = buffer_write(buf);
+                buffer_release(buf);
                 kfree(dos_file_name);
-                return 1;
+                return ret;
             }
         }
+        buffer_release(buf);
     }
     kfree(dos_file_name);
     return 0;
 }
 
-void fat_read(file *f, char *buf) {
-    if(!f)
-        return;
-    
-    device_t *dev = get_dev_by_id(f->dev);
-    unsigned char *sector = (unsigned char *) dev->read(get_phys_sector(f));
-    memcpy(buf, sector, SECTOR_SIZE);
-    
+/**
+ * Moves the file to the next cluster of its chain, sets eof at the end
+ */
+static void fat_next_cluster(device_t *dev, file *f) {
     uint32_t fat_offset;
     switch(dev->minfo.type) {
         case FAT12:
@@ -189,13 +201,31 @@ void fat_read(file *f, char *buf) {
     }
     uint32_t fat_sector = dev->minfo.fat_offset + (fat_offset / SECTOR_SIZE);
     uint32_t entry_offset = fat_offset % SECTOR_SIZE;
-    sector = (unsigned char *) dev->read(fat_sector);
-    memcpy(FAT, sector, SECTOR_SIZE);
-    sector = (unsigned char *) dev->read(fat_sector + 1);
-    memcpy(FAT + SECTOR_SIZE, sector, SECTOR_SIZE);
+    
+    uint8_t entry[4];
+    uint32_t entry_size = (dev->minfo.type == FAT32) ? 4 : 2;
+    buffer_head_t *buf = buffer_read(dev, fat_sector);
+    if(!buf) {
+        f->eof = 1;
+        return;
+    }
+    if(entry_offset + entry_size > SECTOR_SIZE) {
+        // Only a FAT12 entry can cross into the next sector
+        entry[0] = buf->data[entry_offset];
+        buffer_release(buf);
+        buf = buffer_read(dev, fat_sector + 1);
+        if(!buf) {
+            f->eof = 1;
+            return;
+        }
+        entry[1] = buf->data[0];
+    } else {
+        memcpy(entry, buf->data + entry_offset, entry_size);
+    }
+    buffer_release(buf);
     
     if(dev->minfo.type == FAT12) {
-        uint16_t next_cluster = *(uint16_t *) &FAT[entry_offset];
+        uint16_t next_cluster = *(uint16_t *) entry;
         if(f->current_cluster & 0x0001)
             next_cluster >>= 4;
         else
@@ -207,14 +237,14 @@ void fat_read(file *f, char *buf) {
         }
         f->current_cluster = next_cluster;
     } else if(dev->minfo.type == FAT16) {
-        uint16_t next_cluster = *(uint16_t *) &FAT[entry_offset];
+        uint16_t next_cluster = *(uint16_t *) entry;
         if((next_cluster >= 0xFFF8) || (next_cluster == 0)) {
             f->eof = 1;
             return;
         }
         f->current_cluster = next_cluster;
     } else if(dev->minfo.type == FAT32) {
-        uint32_t next_cluster = *(uint32_t *) &FAT[entry_offset] & 0x0FFFFFFF;
+        uint32_t next_cluster = *(uint32_t *) entry & 0x0FFFFFFF;
         if((next_cluster >= 0x0FFFFFF8) || (next_cluster == 0)) {
             f->eof = 1;
             return;
@@ -223,6 +253,34 @@ void fat_read(file *f, char *buf) {
     }
 }
 
+void fat_read(file *f, char *buf) {
+    if(!f)
+        return;
+    
+    device_t *dev = get_dev_by_id(f->dev);
+    buffer_head_t *sector = buffer_read(dev, get_phys_sector(f));
+    if(!sector) {
+        f->eof = 1;
+        return;
+    }
+    memcpy(buf, sector->data, SECTOR_SIZE);
+    buffer_release(sector);
+    
+    fat_next_cluster(dev, f);
+}
+
+/**
+ * Skips the given number of sectors following the FAT, without reading the data
+ */
+void fat_seek(file *f, uint32_t sectors) {
+    if(!f)
+        return;
+    
+    device_t *dev = get_dev_by_id(f->dev);
+    while(sectors-- && !f->eof)
+        fat_next_cluster(dev, f);
+}
+
 void fat_write(file *f, char *str) {
     if(!f)
         return;
@@ -231,15 +289,25 @@ void fat_write(file *f, char *str) {
     to_dos_file_name(f->name, dos_file_name);
     
     device_t *dev = get_dev_by_id(f->dev);
-    memset(dma_buffer, 0, SECTOR_SIZE);
-    memcpy(dma_buffer, str, strlen(str));
-    dev->write(get_phys_sector(f));
-    f->len++;
+    buffer_head_t *buf;
+    directory_t *dir = fat_get_dir(f, &buf);
+    // Programs started from now on mustn't share the pages of the old file
+    if(dir)
+        page_cache_invalidate(f->dev, dir->first_cluster);
+    
+    buffer_head_t *sector = buffer_get(dev, get_phys_sector(f));
+    if(sector) {
+        memset(sector->data, 0, SECTOR_SIZE);
+        memcpy(sector->data, str, strlen(str));
+        buffer_write(sector);
+        buffer_release(sector);
+        f->len++;
+    }
     
-    directory_t *dir = fat_get_dir(f);
     if(dir) {
         dir->file_size = f->len;
-        dev->write(dev->minfo.root_offset + offset);
+        buffer_write(buf);
+        buffer_release(buf);
     }
 }
 
@@ -249,12 +317,15 @@ int fat_delete(char *name) {
         return 0;
     }
     
-    device_t *dev = get_dev_by_id(f.dev);
-    directory_t *dir = fat_get_dir(&f);
+    buffer_head_t *buf;
+    directory_t *dir = fat_get_dir(&f, &buf);
     if(dir) {
+        // Its clusters may hold another file later
+        page_cache_invalidate(f.dev, dir->first_cluster);
         memset(dir, 0, sizeof(directory_t));
-        dev->write(dev->minfo.root_offset + offset);
-        return 1;
+        int ret = buffer_write(buf);
+        buffer_release(buf);
+        return ret;
     }
     return 0;
 }
@@ -270,7 +341,8 @@ file fat_directory(char *dir_name, int devid) {
     f.dev = devid;
     f.eof = 0;
     
-    directory_t *dir = fat_get_dir(&f);
+    buffer_head_t *buf;
+    directory_t *dir = fat_get_dir(&f, &buf);
     if(dir) {
         f.current_cluster = dir->first_cluster;
         f.len = dir->file_size;
@@ -278,6 +350,7 @@ file fat_directory(char *dir_name, int devid) {
             f.type = FS_DIR;
         else
             f.type = FS_FILE;
+        buffer_release(buf);
     } else {
         f.type = FS_NULL;
     }
@@ -356,13 +429,17 @@ void fat_ls(char *dir) {
     // TODO nested folder
     device_t *dev = get_dev_by_name(dir);
     for(int i = 0; i < 14; i++) {
-        directory_t *direc = (directory_t *) dev->read(dev->minfo.root_offset + i);
+        buffer_head_t *buf = buffer_read(dev, dev->minfo.root_offset + i);
+        if(!buf)
+            break;
+        directory_t *direc = (directory_t *) buf->data;
         for(int j = 0; j < 16; j++, direc++) {
             if(((char *) direc->filename)[0] == 0)
                 continue;
             to_normal_file_name((char *) direc->filename, normal_name);
             console_print("%s  ", normal_name);
         }
+        buffer_release(buf);
     }
     console_print("\n");
     kfree(normal_name);
@@ -372,6 +449,7 @@ void fat_init(filesystem *fs_fat) {
     fs_fat->mount = &fat_mount;
     fs_fat->read = &fat_read;
     fs_fat->write = &fat_write;
+    fs_fat->seek = &fat_seek;
     fs_fat->close = &fat_close;
     fs_fat->open = &fat_open;
     fs_fat->ls = &fat_ls;
@@ -22,15 +22,33 @@
 #include <drivers/video.h>
 #include <hal/device.h>
 #include <proc/sched.h>
+#include <proc/mutex.h>
+#include <mm/paging.h>
 
 static filesystem *devs[MAX_DEVICES];
 
+// The file systems share their buffers and sleep on the disk, one call at a time
+static mutex_t vfs_lock = MUTEX_INIT;
+
+/**
+ * Touches every page of a buffer before vfs_lock is taken, a page of a
+ * program image is loaded on its first access through the vfs itself
+ */
+static void vfs_fault_in(char *buf, uint32_t len) {
+    volatile char *p = (volatile char *) buf;
+    for(uint32_t i = 0; i < len; i += PAGE_SIZE - ((uint32_t) (p + i) % PAGE_SIZE))
+        (void) p[i];
+    if(len)
+        (void) p[len - 1];
+}
+
 void vfs_init() {
     for(int i = 0; i < MAX_DEVICES; i++)
         devs[i] = NULL;
 }
 
 void vfs_ls() {
+    mutex_lock(&vfs_lock);
     for(int i = 0; i < MAX_DEVICES; i++) {
         if(devs[i] != NULL) {
             device_t *device = get_dev_by_id(i);
@@ -38,58 +56,69 @@ void vfs_ls() {
                 console_print("%s\n", device->mount);
         }
     }
+    mutex_unlock(&vfs_lock);
 }
 
 void vfs_ls_dir(char *dir) {
     int device = get_dev_id_by_name(dir);
+    mutex_lock(&vfs_lock);
     if(device >= 0) {
         if(devs[device])
-            return devs[device]->ls(dir + 1);
+            devs[device]->ls(dir + 1);
     }
+    mutex_unlock(&vfs_lock);
 }
 
 int vfs_cd(char *name) {
+    int ret = 0;
     int device = get_dev_id_by_name(name);
+    mutex_lock(&vfs_lock);
     if(device >= 0) {
         if(devs[device]) {
             char *p = strchr(name + 1, '/');
             if(p) {
                 file f = devs[device]->cd(name + 1);
-                if(f.type == FS_DIR) {
-                    return 1;
-                } else {
-                    return 0;
-                }
+                ret = (f.type == FS_DIR);
+            } else {
+                ret = 1;
             }
-            return 1;
         }
     }
-    return 0;
+    mutex_unlock(&vfs_lock);
+    return ret;
 }
 
 int vfs_touch(char *name) {
+    int ret = 0;
     int device = get_dev_id_by_name(name);
+    mutex_lock(&vfs_lock);
     if(device >= 0) {
         if(devs[device]) {
-            return devs[device]->touch(name + 1);
+            ret = devs[device]->touch(name + 1);
         }
     }
-    return 0;
+    mutex_unlock(&vfs_lock);
+    return ret;
 }
 
 int vfs_delete(char *name) {
+    int ret = 0;
     int device = get_dev_id_by_name(name);
+    mutex_lock(&vfs_lock);
     if(device >= 0) {
         if(devs[device]) {
-            return devs[device]->delete(name + 1);
+            ret = devs[device]->delete(name + 1);
         }
     }
-    return 0;
+    mutex_unlock(&vfs_lock);
+    return ret;
 }
 
 file *vfs_file_open(char *name, char *mode) {
     int device = get_dev_id_by_name(name);
     file *f = kmalloc(sizeof(file));
+    f->type = FS_NULL;
+    mutex_lock(&vfs_lock);
     if(device >= 0) {
         if(devs[device]) {
             *f = devs[device]->open(name + 1);
@@ -97,19 +126,24 @@ file *vfs_file_open(char *name, char *mode) {
                 if(strcmp(mode, "w") == 0) {
                     f->len = 0;
                 }
-                return f;
+            } else {
+                f->type = FS_NULL;
             }
         }
     }
-    f->type = FS_NULL;
+    mutex_unlock(&vfs_lock);
     return f;
 }
 
 file *vfs_file_open_user(char *name, char *mode) {
-    process_t *cur = get_cur_proc();
-    if(cur && cur->thread_list) {
-        file *f = (file *) umalloc(sizeof(file), (vmm_addr_t *) cur->thread_list->heap);
+    thread_t *cur = get_cur_thread();
+    file *ret = NULL;
+    if(cur) {
+        file *f = (file *) umalloc(sizeof(file), (vmm_addr_t *) cur->heap);
+        vfs_fault_in(name, strlen(name) + 1);
+        vfs_fault_in(mode, strlen(mode) + 1);
         int device = get_dev_id_by_name(name);
+        mutex_lock(&vfs_lock);
         if(device >= 0 && devs[device]) {
             file fil = devs[device]->open(name + 1);
             memcpy(f, &fil, sizeof(file));
@@ -117,46 +151,69 @@ file *vfs_file_open_user(char *name, char *mode) {
                 if(strcmp(mode, "w") == 0) {
                     f->len = 0;
                 }
-                return f;
+                ret = f;
             }
         }
+        mutex_unlock(&vfs_lock);
     }
-    return NULL;
+    return ret;
 }
 
 void vfs_file_read(file *f, char *str) {
     if(f) {
+        vfs_fault_in(str, VFS_BLOCK_SIZE);
+        mutex_lock(&vfs_lock);
         if(devs[f->dev]) {
             devs[f->dev]->read(f, str);
         }
+        mutex_unlock(&vfs_lock);
     }
 }
 
 void vfs_file_write(file *f, char *str) {
     if(f) {
+        vfs_fault_in(str, strlen(str) + 1);
+        mutex_lock(&vfs_lock);
         if(devs[f->dev])
             devs[f->dev]->write(f, str);
+        mutex_unlock(&vfs_lock);
     } 
 }
 
+/**
+ * Skips sectors of the file without reading them
+ */
+void vfs_file_seek(file *f, uint32_t sectors) {
+    if(f) {
+        mutex_lock(&vfs_lock);
+        if(devs[f->dev] && devs[f->dev]->seek)
+            devs[f->dev]->seek(f, sectors);
+        mutex_unlock(&vfs_lock);
+    }
+}
+
 void vfs_file_close(file *f) {
     if(f) {
+        mutex_lock(&vfs_lock);
         if(devs[f->dev]) {
             devs[f->dev]->close(f);
             kfree(f);
         }
+        mutex_unlock(&vfs_lock);
     }
 }
 
 void vfs_file_close_user(file *f) {
     if(f) {
+        mutex_lock(&vfs_lock);
         if(devs[f->dev]) {
             devs[f->dev]->close(f);
-            process_t *cur = get_cur_proc();
-            if(cur && cur->thread_list) {
-                ufree(f, (vmm_addr_t *) cur->thread_list->heap);
+            thread_t *cur = get_cur_thread();
+            if(cur) {
+                ufree(f, (vmm_addr_t *) cur->heap);
             }
         }
+        mutex_unlock(&vfs_lock);
     }
 }
 
@@ -173,14 +230,19 @@ int vfs_get_dev(char *name) {
 void vfs_mount(char *name) {
     device_t *dev = get_dev_by_name(name);
     if(&dev->fs) {
+        mutex_lock(&vfs_lock);
         devs[dev->id] = &dev->fs;
         fat_mount(dev);
+        mutex_unlock(&vfs_lock);
     }
 }
 
 void vfs_unmount(char *name) {
     device_t *dev = get_dev_by_name(name);
-    if(&dev->fs)
+    if(&dev->fs) {
+        mutex_lock(&vfs_lock);
         devs[dev->id] = NULL;
+        mutex_unlock(&vfs_lock);
+    }
 }
 
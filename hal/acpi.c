@@ -0,0 +1,108 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/acpi.h>
+#include <mm/memory.h>
+#include <lib/string.h>
+
+static int acpi_checksum(void *table, uint32_t len) {
+    uint8_t sum = 0;
+    for(uint32_t i = 0; i < len; i++)
+        sum += ((uint8_t *) table)[i];
+    return sum == 0;
+}
+
+/**
+ * The tables can be anywhere in memory, map them where they are
+ */
+static void acpi_map(uint32_t addr, uint32_t len) {
+    for(uint32_t page = addr & ~0xFFF; page < addr + len; page += PAGE_SIZE) {
+        if(!get_phys_addr(get_kern_directory(), page))
+            vmm_map_phys(get_kern_directory(), page, page, PAGE_PRESENT);
+    }
+}
+
+static rsdp_t *acpi_scan(uint32_t start, uint32_t len) {
+    for(uint32_t addr = start; addr < start + len; addr += 16) {
+        rsdp_t *rsdp = (rsdp_t *) addr;
+        if(!strncmp(rsdp->signature, ACPI_RSDP_SIGNATURE, 8) && acpi_checksum(rsdp, sizeof(rsdp_t)))
+            return rsdp;
+    }
+    return NULL;
+}
+
+/**
+ * Looks for the RSDP in the first KB of the EBDA and in the BIOS area
+ */
+static rsdp_t *acpi_find_rsdp() {
+    uint32_t ebda = (uint32_t) *((uint16_t *) 0x40E) << 4;
+    rsdp_t *rsdp = NULL;
+    if(ebda)
+        rsdp = acpi_scan(ebda, 1024);
+    if(rsdp == NULL)
+        rsdp = acpi_scan(0xE0000, 0x20000);
+    return rsdp;
+}
+
+static sdt_header_t *acpi_find_table(rsdp_t *rsdp, char *signature) {
+    acpi_map(rsdp->rsdt, sizeof(sdt_header_t));
+    sdt_header_t *rsdt = (sdt_header_t *) rsdp->rsdt;
+    acpi_map(rsdp->rsdt, rsdt->length);
+    if(!acpi_checksum(rsdt, rsdt->length))
+        return NULL;
+    
+    uint32_t *tables = (uint32_t *) (rsdt + 1);
+    uint32_t n = (rsdt->length - sizeof(sdt_header_t)) / 4;
+    for(uint32_t i = 0; i < n; i++) {
+        acpi_map(tables[i], sizeof(sdt_header_t));
+        sdt_header_t *table = (sdt_header_t *) tables[i];
+        if(!strncmp(table->signature, signature, 4)) {
+            acpi_map(tables[i], table->length);
+            if(acpi_checksum(table, table->length))
+                return table;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Fills apic_ids with the local APIC ids of the enabled CPUs listed in
+ * the MADT, returns how many there are
+ */
+int acpi_find_cpus(uint8_t *apic_ids, int max) {
+    rsdp_t *rsdp = acpi_find_rsdp();
+    if(rsdp == NULL)
+        return 0;
+    madt_t *madt = (madt_t *) acpi_find_table(rsdp, ACPI_MADT_SIGNATURE);
+    if(madt == NULL)
+        return 0;
+    
+    int n = 0;
+    uint8_t *entry = (uint8_t *) (madt + 1);
+    uint8_t *end = (uint8_t *) madt + madt->header.length;
+    while((entry < end) && (n < max)) {
+        madt_entry_t *header = (madt_entry_t *) entry;
+        if(header->length == 0)
+            break;
+        if(header->type == MADT_LAPIC) {
+            madt_lapic_t *lapic = (madt_lapic_t *) entry;
+            if(lapic->flags & MADT_LAPIC_ENABLED)
+                apic_ids[n++] = lapic->apic_id;
+        }
+        entry += header->length;
+    }
+    return n;
+}
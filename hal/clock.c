@@ -0,0 +1,95 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/clock.h>
+#include <hal/hal.h>
+#include <proc/sched.h>
+#include <lib/math.h>
+
+/*
+ * Monotonic clock in ns since boot. It reads the TSC, calibrated against
+ * the PIT, or falls back to the scheduler timer when there's no TSC.
+ */
+static int tsc = 0;
+static uint32_t tsc_khz = 0;        // TSC cycles per ms
+static uint64_t tsc_base = 0;
+
+static uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+void clock_init() {
+    if(!cpu_has_feature(CPUID_FEAT_EDX_TSC))
+        return;
+    
+    uint32_t rem;
+    uint64_t start = rdtsc();
+    pit_wait(CLOCK_CALIBRATE_MS);
+    tsc_khz = (uint32_t) div64(rdtsc() - start, CLOCK_CALIBRATE_MS, &rem);
+    if(tsc_khz == 0)
+        return;
+    
+    tsc_base = start;
+    tsc = 1;
+}
+
+/**
+ * Nanoseconds since boot
+ */
+uint64_t clock_now() {
+    if(!tsc)
+        return timer_now();
+    
+    // Split in ms and the rest so the multiplication can't overflow
+    uint32_t rem, rem_ns;
+    uint64_t ms = div64(rdtsc() - tsc_base, tsc_khz, &rem);
+    return ms * 1000000 + div64((uint64_t) rem * 1000000, tsc_khz, &rem_ns);
+}
+
+/**
+ * Gives the TSC calibration, returns 0 if the clock doesn't use the TSC
+ */
+int clock_tsc(uint32_t *khz, uint64_t *base) {
+    *khz = tsc ? tsc_khz : 0;
+    *base = tsc_base;
+    return tsc;
+}
+
+int clock_gettime_sys(int clk, struct timespec *ts) {
+    if((clk != CLOCK_MONOTONIC) || (ts == NULL))
+        return -1;
+    
+    uint32_t nsec;
+    ts->tv_sec = (time_t) div64(clock_now(), NSEC_PER_SEC, &nsec);
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
+int nanosleep_sys(const struct timespec *req, struct timespec *rem) {
+    if((req == NULL) || (req->tv_sec < 0) || (req->tv_nsec < 0) || (req->tv_nsec >= NSEC_PER_SEC))
+        return -1;
+    
+    sched_sleep((uint64_t) req->tv_sec * NSEC_PER_SEC + req->tv_nsec);
+    
+    // Nothing can interrupt the sleep earlier
+    if(rem != NULL) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+    return 0;
+}
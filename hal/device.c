@@ -18,41 +18,50 @@
 #include <lib/string.h>
 #include <fs/vfs.h>
 #include <drivers/video.h>
+#include <proc/rwlock.h>
 
 static device_t *devices[8];
+static rwlock_t devices_lock = RWLOCK_INIT;
 
 void device_register(device_t *dev) {
     if(dev->id < 8) {
+        write_lock(&devices_lock);
         devices[dev->id] = dev;
+        write_unlock(&devices_lock);
         vfs_mount(dev->mount);
     }
 }
 
 device_t *get_dev_by_name(char *name) {
+    device_t *dev = NULL;
     if(name[0] == '/')
         name++;
+    read_lock(&devices_lock);
     for(int i = 0; i < 8; i++) {
-        if(strncmp(devices[i]->mount, name, 3) == 0)
-            return devices[i];
+        if(strncmp(devices[i]->mount, name, 3) == 0) {
+            dev = devices[i];
+            break;
+        }
     }
-    return NULL;
+    read_unlock(&devices_lock);
+    return dev;
 }
 
 device_t *get_dev_by_id(int id) {
+    device_t *dev = NULL;
+    read_lock(&devices_lock);
     for(int i = 0; i < 8; i++) {
-        if(devices[i]->id == id)
-            return devices[i];
+        if(devices[i]->id == id) {
+            dev = devices[i];
+            break;
+        }
     }
-    return NULL;
+    read_unlock(&devices_lock);
+    return dev;
 }
 
 int get_dev_id_by_name(char *name) {
-    if(name[0] == '/')
-        name++;
-    for(int i = 0; i < 8; i++) {
-        if(strncmp(devices[i]->mount, name, 3) == 0)
-            return devices[i]->id;
-    }
-    return -1;
+    device_t *dev = get_dev_by_name(name);
+    return (dev != NULL) ? dev->id : -1;
 }
 
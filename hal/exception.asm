@@ -50,6 +50,28 @@ invop_handle:
     call ex_invalid_opcode
     ret
 
+extern ex_device_not_available
+
+global nm_handle
+nm_handle:
+    pushad
+    push gs
+    push fs
+    push es
+    push ds
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    call ex_device_not_available
+    pop ds
+    pop es
+    pop fs
+    pop gs
+    popad
+    iretd
+
 extern ex_page_fault
 
 global pf_handle
@@ -67,6 +89,12 @@ pf_handle:
     push esp
     call ex_page_fault
     add esp, $4
+    pop ds
+    pop es
+    pop fs
+    pop gs
+    popa
+    add esp, $4         ; error code
     iretd
 
 extern syscall_disp
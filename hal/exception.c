@@ -20,6 +20,7 @@
 #include <drivers/video.h>
 #include <proc/proc.h>
 #include <proc/thread.h>
+#include <elf.h>
 
 void (*return_error)() = (void *) RETURN_ADDR;
 
@@ -72,8 +73,7 @@ void ex_invalid_opcode(struct regs *re) {
 }
 
 void ex_device_not_available() {
-    console_print("Device not available\n");
-    panic();
+    fpu_trap();
 }
 
 void ex_double_fault() {
@@ -112,6 +112,10 @@ void ex_gpf(struct regs_error *re) {
 
 void ex_page_fault(struct regs_error *re) {
     int virt_addr = get_cr2();
+    // The pages of the executable are loaded on their first access
+    if(!(re->error & PAGE_PRESENT) && elf_fault(virt_addr))
+        return;
+    
     mm_addr_t phys_addr = (mm_addr_t) get_phys_addr(get_page_directory(), virt_addr);
     
     console_print("\nPage fault at addr: 0x%x\n", virt_addr);
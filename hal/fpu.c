@@ -0,0 +1,141 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/fpu.h>
+#include <hal/smp.h>
+#include <drivers/cpu.h>
+#include <mm/memory.h>
+#include <proc/sched.h>
+#include <console.h>
+#include <panic.h>
+
+// fxsave needs a 16 bytes aligned area
+#define FPU_AREA(thread)    ((void *) (((uint32_t) (thread)->fpu_state + 15) & ~15))
+
+static int fpu_fxsr;
+static int fpu_sse;
+
+// Thread whose state is in the FPU registers of each CPU
+static thread_t *fpu_owner[MAX_CPUS];
+
+static void fpu_set_ts() {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    asm volatile("mov %0, %%cr0" : : "r" (cr0 | CR0_TS));
+}
+
+static void fpu_save(thread_t *thread) {
+    if(fpu_fxsr)
+        asm volatile("fxsave (%0)" : : "r" (FPU_AREA(thread)) : "memory");
+    else
+        asm volatile("fnsave (%0); fwait" : : "r" (FPU_AREA(thread)) : "memory");
+}
+
+static void fpu_restore(thread_t *thread) {
+    if(fpu_fxsr)
+        asm volatile("fxrstor (%0)" : : "r" (FPU_AREA(thread)) : "memory");
+    else
+        asm volatile("frstor (%0)" : : "r" (FPU_AREA(thread)) : "memory");
+}
+
+/**
+ * Gives a thread a clean FPU the first time it uses it
+ */
+static void fpu_reset() {
+    asm volatile("fninit");
+    if(fpu_sse) {
+        uint32_t mxcsr = FPU_MXCSR_DEFAULT;
+        asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+    }
+}
+
+/**
+ * Enables the FPU and SSE on the calling CPU, the first FPU instruction
+ * of every thread traps until it gets the FPU
+ */
+void fpu_init() {
+    fpu_fxsr = cpu_has_feature(CPUID_FEAT_EDX_FXSR);
+    fpu_sse = fpu_fxsr && cpu_has_feature(CPUID_FEAT_EDX_SSE);
+    
+    uint32_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    asm volatile("mov %0, %%cr0" : : "r" (cr0));
+    
+    if(fpu_fxsr) {
+        asm volatile("mov %%cr4, %0" : "=r" (cr4));
+        cr4 |= CR4_OSFXSR;
+        if(fpu_sse)
+            cr4 |= CR4_OSXMMEXCPT;
+        asm volatile("mov %0, %%cr4" : : "r" (cr4));
+    }
+    
+    fpu_reset();
+    fpu_set_ts();
+}
+
+/**
+ * Called when prev leaves the CPU. Integer only threads never own the FPU
+ * and cost nothing here. The owner's state is saved now because its next
+ * slice may be on another CPU, whose #NM handler couldn't reach these
+ * registers.
+ */
+void fpu_switch(thread_t *prev) {
+    int cpu = smp_cpu_id();
+    if(fpu_owner[cpu] != prev)
+        return;
+    
+    fpu_save(prev);
+    fpu_owner[cpu] = NULL;
+    fpu_set_ts();
+}
+
+/**
+ * Device not available, the running thread touched the FPU while CR0.TS
+ * was set. It gets its registers back or a clean FPU the first time.
+ */
+void fpu_trap() {
+    int cpu = smp_cpu_id();
+    thread_t *cur = get_cur_thread();
+    
+    asm volatile("clts");
+    if(cur == NULL) {
+        fpu_reset();
+        return;
+    }
+    if(fpu_owner[cpu] == cur)
+        return;
+    
+    if(cur->fpu_state == NULL) {
+        cur->fpu_state = kmalloc(FPU_STATE_SIZE + 15);
+        if(cur->fpu_state == NULL) {
+            console_print("No memory for the FPU state\n");
+            panic();
+        }
+        fpu_reset();
+    } else {
+        fpu_restore(cur);
+    }
+    fpu_owner[cpu] = cur;
+}
+
+void fpu_free(thread_t *thread) {
+    if(thread->fpu_state == NULL)
+        return;
+    kfree(thread->fpu_state);
+    thread->fpu_state = NULL;
+}
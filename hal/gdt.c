@@ -15,12 +15,14 @@
  */
 
 #include <hal/gdt.h>
+#include <hal/smp.h>
 #include <drivers/video.h>
 
 #define GDT_LEN 8
 
-struct gdt_info gdt_tab[GDT_LEN];
-struct gdt_ptr ptr;
+// Every CPU has its own table, they differ in the TSS entry
+struct gdt_info gdt_tab[MAX_CPUS][GDT_LEN];
+struct gdt_ptr ptr[MAX_CPUS];
 
 void gdt_init() {
     gdt_set_entry(0, 0, 0, 0);
@@ -29,18 +31,20 @@ void gdt_init() {
     gdt_set_entry(3, 0, 0xFFFFFFFF, 0xFA);
     gdt_set_entry(4, 0, 0xFFFFFFFF, 0xF2);
     
-    ptr.base = (uint32_t) &gdt_tab;
-    ptr.limit = (sizeof(struct gdt_info) * GDT_LEN) - 1;
+    int cpu = smp_cpu_id();
+    ptr[cpu].base = (uint32_t) &gdt_tab[cpu];
+    ptr[cpu].limit = (sizeof(struct gdt_info) * GDT_LEN) - 1;
     
-    gdt_set(&ptr);
+    gdt_set(&ptr[cpu]);
 }
 
 void gdt_set_entry(int index, uint32_t base, uint32_t limit, uint8_t access) {
-    gdt_tab[index].base_low = base & 0xFFFF;
-    gdt_tab[index].base_middle = (base >> 16) & 0xFF;
-    gdt_tab[index].base_high = (base >> 24) & 0xFF;
-    gdt_tab[index].limit_low = limit & 0xFFFF;
-    gdt_tab[index].granularity = ((limit >> 16) & 0x0F) | (0xCF & 0xF0);
-    gdt_tab[index].flags = access;
+    struct gdt_info *gdt = gdt_tab[smp_cpu_id()];
+    gdt[index].base_low = base & 0xFFFF;
+    gdt[index].base_middle = (base >> 16) & 0xFF;
+    gdt[index].base_high = (base >> 24) & 0xFF;
+    gdt[index].limit_low = limit & 0xFFFF;
+    gdt[index].granularity = ((limit >> 16) & 0x0F) | (0xCF & 0xF0);
+    gdt[index].flags = access;
 }
 
@@ -15,22 +15,27 @@
  */
 
 #include <hal/hal.h>
+#include <hal/latency.h>
+#include <proc/sched.h>
 
 void hal_init() {
     disable_int();
     gdt_init();
+    fpu_init();
     idt_init(0x8);
     pic_init(0x20, 0x28);
     pit_init();
-    pit_start_counter(100, PIT_COUNTER_0, PIT_MODE_SQUAREWAVEGEN);
+    clock_init();
+    latency_init();
+    timer_init();
     enable_int();
 }
 
-void sleep(int s) {
-    // TODO better solution
-    int ticks = get_tick_count() + s;
-    int passed = 0;
-    while((passed += get_tick_count()) < ticks);
+/**
+ * Waits for ms milliseconds, blocking the calling thread
+ */
+void sleep(int ms) {
+    sched_sleep((uint64_t) ms * 1000000);
 }
 
 void reboot() {
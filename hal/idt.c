@@ -41,7 +41,7 @@ void idt_init(uint16_t code) {
     install_ir(4, 0x80 | 0x0E, code, &ex_overflow);
     install_ir(5, 0x80 | 0x0E, code, &ex_bounds_check);
     install_ir(6, 0x80 | 0x0E, code, &invop_handle);
-    install_ir(7, 0x80 | 0x0E, code, &ex_device_not_available);
+    install_ir(7, 0x80 | 0x0E, code, &nm_handle);
     install_ir(8, 0x80 | 0x0E, code, &ex_double_fault);
     install_ir(10, 0x80 | 0x0E, code, &ex_invalid_tss);
     install_ir(11, 0x80 | 0x0E, code, &ex_segment_not_present);
@@ -53,6 +53,13 @@ void idt_init(uint16_t code) {
     install_ir(18, 0x80 | 0x0E, code, &ex_machine_check);
     install_ir(19, 0x80 | 0x0E, code, &ex_simd_fpu);
     
+    idt_load();
+}
+
+/**
+ * Loads the shared table on the calling CPU
+ */
+void idt_load() {
     idt_set(&idtr);
 }
 
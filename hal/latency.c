@@ -0,0 +1,116 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/latency.h>
+#include <hal/clock.h>
+#include <hal/smp.h>
+#include <lib/math.h>
+
+/*
+ * Windows are measured in TSC cycles, without a TSC nothing is recorded.
+ * The callers have the interrupts disabled, so every CPU only touches its
+ * own entries.
+ */
+typedef struct latency_cpu {
+    uint64_t start[LATENCY_KINDS];
+    void *start_site[LATENCY_KINDS];
+    uint64_t max[LATENCY_KINDS];
+    void *max_start[LATENCY_KINDS];
+    void *max_end[LATENCY_KINDS];
+} latency_cpu_t;
+
+static latency_cpu_t latency[MAX_CPUS];
+static uint32_t latency_khz = 0;
+
+static uint64_t latency_now() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/**
+ * Starts measuring once the clock is calibrated
+ */
+void latency_init() {
+    uint64_t base;
+    clock_tsc(&latency_khz, &base);
+}
+
+void latency_start(int kind, void *site) {
+    if(latency_khz == 0)
+        return;
+    latency_cpu_t *cpu = &latency[smp_cpu_id()];
+    cpu->start[kind] = latency_now();
+    cpu->start_site[kind] = site;
+}
+
+void latency_end(int kind, void *site) {
+    if(latency_khz == 0)
+        return;
+    latency_cpu_t *cpu = &latency[smp_cpu_id()];
+    // Opened before the measures started
+    if(cpu->start_site[kind] == NULL)
+        return;
+    
+    uint64_t len = latency_now() - cpu->start[kind];
+    if(len > cpu->max[kind]) {
+        cpu->max[kind] = len;
+        cpu->max_start[kind] = cpu->start_site[kind];
+        cpu->max_end[kind] = site;
+    }
+    cpu->start_site[kind] = NULL;
+}
+
+/**
+ * Forgets the open window, the thread that opened it left the CPU
+ */
+void latency_cancel(int kind) {
+    latency[smp_cpu_id()].start_site[kind] = NULL;
+}
+
+/**
+ * Finds the longest window of a kind among the CPUs
+ */
+void latency_get(int kind, struct latency_window *window) {
+    window->max = 0;
+    window->start_site = NULL;
+    window->end_site = NULL;
+    window->cpu = -1;
+    if(latency_khz == 0)
+        return;
+    
+    uint64_t max = 0;
+    for(int i = 0; i < smp_ncpus(); i++) {
+        if(latency[i].max[kind] > max) {
+            max = latency[i].max[kind];
+            window->start_site = latency[i].max_start[kind];
+            window->end_site = latency[i].max_end[kind];
+            window->cpu = i;
+        }
+    }
+    
+    // Split in ms and the rest like clock_now
+    uint32_t rem, rem_ns;
+    uint64_t ms = div64(max, latency_khz, &rem);
+    window->max = ms * 1000000 + div64((uint64_t) rem * 1000000, latency_khz, &rem_ns);
+}
+
+void latency_reset() {
+    for(int i = 0; i < smp_ncpus(); i++) {
+        for(int j = 0; j < LATENCY_KINDS; j++)
+            latency[i].max[j] = 0;
+    }
+}
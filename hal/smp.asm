@@ -0,0 +1,150 @@
+;
+;  Copyright 2016 Davide Pianca
+;
+;  Licensed under the Apache License, Version 2.0 (the "License");
+;  you may not use this file except in compliance with the License.
+;  You may obtain a copy of the License at
+;
+;      http://www.apache.org/licenses/LICENSE-2.0
+;
+;  Unless required by applicable law or agreed to in writing, software
+;  distributed under the License is distributed on an "AS IS" BASIS,
+;  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+;  See the License for the specific language governing permissions and
+;  limitations under the License.
+;
+
+%define TRAMPOLINE_BASE     0x9000
+%define REBASE(x)           (((x) - smp_trampoline) + TRAMPOLINE_BASE)
+
+extern smp_ap_main
+extern smp_resched_interrupt
+extern smp_tlb_interrupt
+
+section .text
+
+; Application processors start here in real mode after the startup IPI,
+; the code is copied at TRAMPOLINE_BASE and runs from there
+global smp_trampoline
+smp_trampoline:
+bits 16
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    
+    lgdt [REBASE(tramp_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                       ; protected mode
+    mov cr0, eax
+    jmp dword 0x08:REBASE(tramp_pmode)
+
+bits 32
+tramp_pmode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    
+    mov eax, [REBASE(smp_tramp_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000              ; paging, same directory as the kernel
+    mov cr0, eax
+    
+    mov esp, [REBASE(smp_tramp_stack)]
+    mov eax, smp_ap_main
+    call eax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; code
+    dq 0x00CF92000000FFFF           ; data
+tramp_gdt_ptr:
+    dw 23
+    dd REBASE(tramp_gdt)
+
+global smp_tramp_cr3
+smp_tramp_cr3:
+    dd 0
+global smp_tramp_stack
+smp_tramp_stack:
+    dd 0
+
+global smp_trampoline_end
+smp_trampoline_end:
+
+; Reschedule request from another CPU, same frame as pit_int
+global smp_resched_int
+smp_resched_int:
+
+    ; push registers
+    push eax
+    push ebx
+    push ecx
+    push edx
+    push esi
+    push edi
+    push ebp
+    push ds
+    push es
+    push fs
+    push gs
+    
+    mov ebx, esp            ; save stack pointer
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    
+    push ebx
+    call smp_resched_interrupt
+    
+    mov esp, eax            ; change stack pointer
+    
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    
+    pop ebp
+    pop edi
+    pop esi
+    pop edx
+    pop ecx
+    pop ebx
+    pop eax
+    iretd
+
+; TLB shootdown request from another CPU
+global smp_tlb_int
+smp_tlb_int:
+    pushad
+    push gs
+    push fs
+    push es
+    push ds
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    call smp_tlb_interrupt
+    
+    pop ds
+    pop es
+    pop fs
+    pop gs
+    popad
+    iretd
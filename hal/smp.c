@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/smp.h>
+#include <hal/acpi.h>
+#include <hal/hal.h>
+#include <drivers/apic.h>
+#include <proc/sched.h>
+#include <proc/spinlock.h>
+#include <mm/memory.h>
+#include <lib/string.h>
+
+// The trampoline variables, as seen once it's copied at SMP_TRAMPOLINE
+#define TRAMPOLINE_VAR(v) ((uint32_t *) (SMP_TRAMPOLINE + ((uint32_t) (v) - (uint32_t) smp_trampoline)))
+
+extern uint8_t smp_trampoline[];
+extern uint8_t smp_trampoline_end[];
+extern uint8_t smp_tramp_cr3[];
+extern uint8_t smp_tramp_stack[];
+extern void smp_resched_int();
+extern void smp_tlb_int();
+
+static cpu_t cpus[MAX_CPUS];
+static int ncpus = 1;
+static int smp_active = 0;
+static uint8_t apic_to_cpu[256];
+static spinlock_t tlb_lock = SPINLOCK_INIT;
+
+/**
+ * Index of the calling CPU, the bootstrap processor is 0
+ */
+int smp_cpu_id() {
+    if(!smp_active)
+        return 0;
+    return apic_to_cpu[apic_id()];
+}
+
+int smp_ncpus() {
+    return ncpus;
+}
+
+cpu_t *smp_get_cpu(int id) {
+    return &cpus[id];
+}
+
+/**
+ * Wakes up an application processor with INIT-SIPI-SIPI and waits for it
+ * to come online
+ */
+static void smp_start_ap(cpu_t *cpu) {
+    cpu->boot_stack = (uint32_t) kmalloc(PAGE_SIZE) + PAGE_SIZE;
+    *TRAMPOLINE_VAR(smp_tramp_stack) = cpu->boot_stack;
+    *TRAMPOLINE_VAR(smp_tramp_cr3) = (uint32_t) get_kern_directory();
+    
+    apic_send_ipi(cpu->apic_id, APIC_ICR_INIT);
+    pit_wait(10);
+    for(int i = 0; (i < 2) && !cpu->online; i++) {
+        apic_send_ipi(cpu->apic_id, APIC_ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+        pit_wait(1);
+    }
+    for(int i = 0; (i < 100) && !cpu->online; i++)
+        pit_wait(1);
+}
+
+/**
+ * Finds the other CPUs in the ACPI tables and starts them, they join the
+ * scheduler with their own run queue
+ */
+void smp_init() {
+    memset(cpus, 0, sizeof(cpus));
+    cpus[0].online = 1;
+    if(!apic_available() || !timer_is_oneshot())
+        return;
+    
+    uint8_t apic_ids[MAX_CPUS];
+    int found = acpi_find_cpus(apic_ids, MAX_CPUS);
+    if(found <= 1)
+        return;
+    
+    install_ir(SMP_RESCHED_INT, 0x80 | 0x0E, 0x8, &smp_resched_int);
+    install_ir(SMP_TLB_INT, 0x80 | 0x0E, 0x8, &smp_tlb_int);
+    
+    uint8_t bsp = apic_id();
+    cpus[0].apic_id = bsp;
+    memset(apic_to_cpu, 0, sizeof(apic_to_cpu));
+    memcpy((void *) SMP_TRAMPOLINE, smp_trampoline, smp_trampoline_end - smp_trampoline);
+    smp_active = 1;
+    
+    for(int i = 0; i < found; i++) {
+        if(apic_ids[i] == bsp)
+            continue;
+        cpu_t *cpu = &cpus[ncpus];
+        cpu->id = ncpus;
+        cpu->apic_id = apic_ids[i];
+        apic_to_cpu[cpu->apic_id] = cpu->id;
+        
+        smp_start_ap(cpu);
+        if(cpu->online)
+            ncpus++;
+        else
+            apic_to_cpu[cpu->apic_id] = 0;
+    }
+    printk("%d CPUs online\n", ncpus);
+}
+
+/**
+ * First C code run by an application processor, on its boot stack
+ */
+void smp_ap_main() {
+    gdt_init();
+    fpu_init();
+    idt_load();
+    install_tss();
+    sysenter_init();
+    timer_init_ap();
+    
+    cpus[smp_cpu_id()].online = 1;
+    sched_init_ap();
+}
+
+void smp_send_resched(int cpu) {
+    if(cpus[cpu].online)
+        apic_send_ipi(cpus[cpu].apic_id, APIC_ICR_FIXED | SMP_RESCHED_INT);
+}
+
+/**
+ * Called by smp_resched_int when another CPU made a thread runnable here
+ */
+uint32_t smp_resched_interrupt(uint32_t esp) {
+    apic_eoi();
+    return schedule(esp);
+}
+
+static void smp_tlb_flush(cpu_t *cpu) {
+    if(cpu->tlb_addr == TLB_FLUSH_ALL)
+        load_pdbr(get_pdbr());
+    else
+        asm volatile("invlpg (%0)" : : "r" (cpu->tlb_addr) : "memory");
+    cpu->tlb_pending = 0;
+}
+
+/**
+ * Makes the other CPUs drop a page from their TLB, addr is a page or
+ * TLB_FLUSH_ALL. Waits until they all did.
+ */
+void smp_tlb_shootdown(uint32_t addr) {
+    if(!smp_active)
+        return;
+    
+    int flags = spin_lock_irqsave(&tlb_lock);
+    int self = smp_cpu_id();
+    for(int i = 0; i < ncpus; i++) {
+        if((i == self) || !cpus[i].online)
+            continue;
+        cpus[i].tlb_addr = addr;
+        cpus[i].tlb_pending = 1;
+        apic_send_ipi(cpus[i].apic_id, APIC_ICR_FIXED | SMP_TLB_INT);
+    }
+    for(int i = 0; i < ncpus; i++) {
+        while(cpus[i].tlb_pending)
+            smp_poll();
+    }
+    spin_unlock_irqrestore(&tlb_lock, flags);
+}
+
+/**
+ * Called while spinning, handles the requests a CPU can't wait for
+ * with the interrupts disabled
+ */
+void smp_poll() {
+    if(smp_active) {
+        cpu_t *cpu = &cpus[smp_cpu_id()];
+        if(cpu->tlb_pending)
+            smp_tlb_flush(cpu);
+    }
+    asm volatile("pause");
+}
+
+/**
+ * Called by smp_tlb_int
+ */
+void smp_tlb_interrupt() {
+    cpu_t *cpu = &cpus[smp_cpu_id()];
+    if(cpu->tlb_pending)
+        smp_tlb_flush(cpu);
+    apic_eoi();
+}
@@ -0,0 +1,83 @@
+;
+;  Copyright 2016 Davide Pianca
+;
+;  Licensed under the Apache License, Version 2.0 (the "License");
+;  you may not use this file except in compliance with the License.
+;  You may obtain a copy of the License at
+;
+;      http://www.apache.org/licenses/LICENSE-2.0
+;
+;  Unless required by applicable law or agreed to in writing, software
+;  distributed under the License is distributed on an "AS IS" BASIS,
+;  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+;  See the License for the specific language governing permissions and
+;  limitations under the License.
+;
+
+; Keep in sync with SYSCALL_STUB in hal/syscall.h
+%define SYSCALL_STUB    0x400800
+
+extern sysenter_disp
+
+; Copied to SYSCALL_STUB in the common page, user code calls it with the
+; system call number in eax and the arguments in ebx, ecx, edx, esi, edi.
+; The kernel finds ecx and edx on the user stack, pointed by ebp.
+global sysenter_stub
+sysenter_stub:
+    push ecx
+    push edx
+    push ebp
+    mov ebp, esp
+    mov dx, cs              ; sysexit only returns to user mode
+    test dl, 3
+    jz .kernel
+    sysenter
+.kernel:
+    mov edx, [esp + 4]
+    int 0x72
+sysenter_ret:
+    pop ebp
+    pop edx
+    pop ecx
+    ret
+global sysenter_stub_end
+sysenter_stub_end:
+
+; Copied instead when the CPU has no sysenter
+global int_stub
+int_stub:
+    int 0x72
+    ret
+global int_stub_end
+int_stub_end:
+
+; SYSENTER_ESP points at the TSS of the CPU, esp0 is the kernel stack of
+; the running thread. The frame is the one of syscall_handle, sysenter_disp
+; reads ecx and edx from the user stack after checking ebp.
+global sysenter_entry
+sysenter_entry:
+    mov esp, [esp + 4]
+    push dword 0x1B
+    push dword SYSCALL_STUB + (sysenter_ret - sysenter_stub)
+    pushad
+    push gs
+    push fs
+    push es
+    push ds
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    push esp
+    call sysenter_disp
+    add esp, 4
+    pop ds
+    pop es
+    pop fs
+    pop gs
+    popad
+    mov edx, [esp]          ; back to sysenter_ret
+    mov ecx, ebp            ; on the user stack
+    sti
+    sysexit
@@ -19,9 +19,14 @@
 #include <hal/syscall.h>
 #include <proc/proc.h>
 #include <proc/thread.h>
+#include <proc/sched.h>
+#include <proc/futex.h>
+#include <proc/io_ring.h>
 #include <drivers/keyboard.h>
+#include <lib/string.h>
+#include <hal/vdso.h>
 
-#define MAX_SYSCALL 11
+#define MAX_SYSCALL 30
 
 typedef uint32_t (*syscall_call_func)(uint32_t, ...);
 
@@ -36,11 +41,68 @@ static void *syscalls[] = {
     &vfs_file_close_user,       // fclose   7
     &console_pwd_user,          // PWD      8
     &umalloc_sys,               // malloc   9
-    &ufree_sys                  // free     10
+    &ufree_sys,                 // free     10
+    &sched_setpriority,         // setpriority 11
+    &sched_getpriority,         // getpriority 12
+    &clock_gettime_sys,         // clock_gettime 13
+    &nanosleep_sys,             // nanosleep 14
+    &sched_setaffinity,         // setaffinity 15
+    &sched_getaffinity,         // getaffinity 16
+    &futex_sys,                 // futex    17
+    &thread_create_sys,         // thread_create 18
+    &thread_join_sys,           // thread_join 19
+    &sched_getstats,            // getschedstats 20
+    &io_setup_sys,              // io_setup 21
+    &io_enter_sys,              // io_enter 22
+    &waitpid_sys,               // waitpid  23
+    &getpid_sys,                // getpid   24
+    &getppid_sys,               // getppid  25
+    &sched_setscheduler,        // setscheduler 26
+    &sched_getscheduler,        // getscheduler 27
+    &execve_sys,                // execve   28
+    &posix_spawn_sys            // posix_spawn 29
 };
 
+/**
+ * Tells if sysenter works, the first Pentium Pro report it without having it
+ */
+static int sysenter_available() {
+    uint32_t eax, ebx, ecx, edx;
+    if(!cpu_has_feature(CPUID_FEAT_EDX_SEP))
+        return 0;
+    cpuid(1, eax, ebx, ecx, edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    return !((family == 6) && (model < 3) && (stepping < 3));
+}
+
+/**
+ * Installs the int 0x72 gate and puts the user entry point in the
+ * common page, the sysenter one if the CPU has it
+ */
 void syscall_init() {
     install_ir(0x72, 0x80 | 0x0E | 0x60, 0x8, &syscall_handle);
+    
+    if(sysenter_available()) {
+        memcpy((void *) SYSCALL_STUB, &sysenter_stub, (uint32_t) &sysenter_stub_end - (uint32_t) &sysenter_stub);
+        sysenter_init();
+    } else {
+        memcpy((void *) SYSCALL_STUB, &int_stub, (uint32_t) &int_stub_end - (uint32_t) &int_stub);
+    }
+    vdso_init();
+}
+
+/**
+ * Points the sysenter MSRs of the calling CPU at sysenter_entry, the
+ * stack is taken from the CPU's TSS
+ */
+void sysenter_init() {
+    if(!sysenter_available())
+        return;
+    cpu_wrmsr(MSR_SYSENTER_CS, 0x8);
+    cpu_wrmsr(MSR_SYSENTER_ESP, (uint32_t) get_tss());
+    cpu_wrmsr(MSR_SYSENTER_EIP, (uint32_t) &sysenter_entry);
 }
 
 void syscall_disp(struct regs *re) {
@@ -51,3 +113,17 @@ void syscall_disp(struct regs *re) {
     syscall_call_func func = syscalls[re->eax];
     re->eax = func(re->ebx, re->ecx, re->edx, re->esi, re->edi);
 }
+
+/**
+ * sysenter takes ecx and edx, the stub saved them on the user stack at
+ * ebp + 8 and ebp + 4. ebp comes from the program, so it's checked first.
+ */
+void sysenter_disp(struct regs *re) {
+    if(!vmm_user_mapped(get_page_directory(), re->ebp + 4, 2 * sizeof(uint32_t))) {
+        re->eax = -1;
+        return;
+    }
+    re->ecx = *(uint32_t *) (re->ebp + 8);
+    re->edx = *(uint32_t *) (re->ebp + 4);
+    syscall_disp(re);
+}
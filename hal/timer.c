@@ -0,0 +1,205 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/timer.h>
+#include <hal/hal.h>
+#include <hal/smp.h>
+#include <drivers/apic.h>
+#include <proc/sched.h>
+#include <proc/spinlock.h>
+#include <lib/math.h>
+
+/*
+ * The local APIC timer is used in one-shot mode when it's available, the
+ * scheduler arms it only for the next event. Without it the PIT keeps
+ * interrupting at PIT_FREQUENCY.
+ */
+static int oneshot = 0;
+static uint32_t timer_freq = 0;     // APIC timer counts per second
+static uint64_t timer_base[MAX_CPUS];   // ns elapsed before the current arm
+static uint32_t timer_armed[MAX_CPUS];  // counts of the current arm
+
+// Pending timers of every CPU, by expiry time
+static ktimer_t *ktimers[MAX_CPUS];
+static spinlock_t ktimer_lock = SPINLOCK_INIT;
+
+static uint64_t counts_to_ns(uint32_t counts) {
+    uint32_t rem;
+    return div64((uint64_t) counts * 1000000000, timer_freq, &rem);
+}
+
+static uint32_t ns_to_counts(uint64_t ns) {
+    uint32_t rem;
+    return (uint32_t) div64(ns * timer_freq, 1000000000, &rem);
+}
+
+void timer_init() {
+    if(apic_init()) {
+        timer_freq = apic_timer_calibrate();
+        if(timer_freq != 0) {
+            oneshot = 1;
+            pic_mask(PIC_IRQ_TIMER);
+            timer_arm(TICK_NS);
+            return;
+        }
+    }
+    pit_start_counter(PIT_FREQUENCY, PIT_COUNTER_0, PIT_MODE_SQUAREWAVEGEN);
+}
+
+/**
+ * Starts the timer of an application processor, the frequency is the
+ * one measured on the bootstrap processor
+ */
+void timer_init_ap() {
+    apic_enable();
+    if(oneshot) {
+        apic_timer_setup();
+        timer_arm(TICK_NS);
+    }
+}
+
+int timer_is_oneshot() {
+    return oneshot;
+}
+
+/**
+ * Nanoseconds since the timer was started
+ */
+uint64_t timer_now() {
+    int flags = disable_int_save();
+    uint64_t now;
+    if(oneshot) {
+        int cpu = smp_cpu_id();
+        now = timer_base[cpu] + counts_to_ns(timer_armed[cpu] - apic_timer_current());
+    } else {
+        now = get_tick_count() * TICK_NS;
+    }
+    restore_int(flags);
+    return now;
+}
+
+/**
+ * Raises the timer interrupt after delta ns, replacing the previous event.
+ * The PIT is periodic and ignores it.
+ */
+void timer_arm(uint64_t delta) {
+    if(!oneshot)
+        return;
+    
+    int flags = disable_int_save();
+    int cpu = smp_cpu_id();
+    timer_base[cpu] += counts_to_ns(timer_armed[cpu] - apic_timer_current());
+    
+    if(delta > TIMER_MAX_NS)
+        delta = TIMER_MAX_NS;
+    uint32_t counts = ns_to_counts(delta);
+    if(counts == 0)
+        counts = 1;
+    timer_armed[cpu] = counts;
+    apic_timer_oneshot(counts);
+    restore_int(flags);
+}
+
+/**
+ * Called by apic_timer_int
+ */
+uint32_t timer_interrupt(uint32_t esp) {
+    apic_eoi();
+    
+    // The scheduler arms the next event, until it runs keep a regular tick
+    if(get_cur_thread() == NULL) {
+        timer_arm(TICK_NS);
+        return esp;
+    }
+    return schedule(esp);
+}
+
+void ktimer_init(ktimer_t *timer, void (*func)(void *data), void *data) {
+    timer->expires = 0;
+    timer->func = func;
+    timer->data = data;
+    timer->pending = 0;
+    timer->cpu = 0;
+    timer->next = NULL;
+}
+
+static void ktimer_unlink(ktimer_t *timer) {
+    ktimer_t **pos = &ktimers[timer->cpu];
+    while((*pos != NULL) && (*pos != timer))
+        pos = &(*pos)->next;
+    if(*pos != NULL)
+        *pos = timer->next;
+    timer->next = NULL;
+    timer->pending = 0;
+}
+
+/**
+ * Queues the timer to expire at the given clock_now() time, it fires on
+ * the calling CPU
+ */
+void ktimer_add(ktimer_t *timer, uint64_t expires) {
+    int flags = spin_lock_irqsave(&ktimer_lock);
+    if(timer->pending)
+        ktimer_unlink(timer);
+    
+    // Keep the queue ordered by expiry time
+    timer->expires = expires;
+    timer->cpu = smp_cpu_id();
+    ktimer_t **pos = &ktimers[timer->cpu];
+    while((*pos != NULL) && ((*pos)->expires <= expires))
+        pos = &(*pos)->next;
+    timer->next = *pos;
+    *pos = timer;
+    timer->pending = 1;
+    spin_unlock_irqrestore(&ktimer_lock, flags);
+}
+
+/**
+ * Removes a timer that didn't expire yet
+ */
+void ktimer_del(ktimer_t *timer) {
+    int flags = spin_lock_irqsave(&ktimer_lock);
+    if(timer->pending)
+        ktimer_unlink(timer);
+    spin_unlock_irqrestore(&ktimer_lock, flags);
+}
+
+/**
+ * Expiry time of the first pending timer of the calling CPU
+ */
+uint64_t ktimer_next() {
+    ktimer_t *first = ktimers[smp_cpu_id()];
+    return (first != NULL) ? first->expires : KTIMER_NONE;
+}
+
+/**
+ * Calls the timers of the calling CPU expired at now, interrupts must be
+ * disabled. The callbacks run without the timer lock held.
+ */
+void ktimer_run(uint64_t now) {
+    ktimer_t **queue = &ktimers[smp_cpu_id()];
+    spin_lock(&ktimer_lock);
+    while((*queue != NULL) && ((*queue)->expires <= now)) {
+        ktimer_t *timer = *queue;
+        *queue = timer->next;
+        timer->next = NULL;
+        timer->pending = 0;
+        spin_unlock(&ktimer_lock);
+        timer->func(timer->data);
+        spin_lock(&ktimer_lock);
+    }
+    spin_unlock(&ktimer_lock);
+}
@@ -16,10 +16,11 @@
 
 #include <hal/hal.h>
 #include <hal/tss.h>
+#include <hal/smp.h>
 #include <lib/string.h>
 #include <drivers/video.h>
 
-static tss_t tss;
+static tss_t tss_tab[MAX_CPUS];
 
 void flush_tss() {
     asm volatile("mov $0x2B, %ax; \
@@ -27,23 +28,30 @@ void flush_tss() {
 }
 
 void install_tss() {
-    uint32_t base = (uint32_t) &tss;
+    tss_t *tss = &tss_tab[smp_cpu_id()];
+    uint32_t base = (uint32_t) tss;
     gdt_set_entry(5, base, base + sizeof(tss_t), 0xE9);
     memset((void *) base, 0, sizeof(tss_t));
 
-    tss.esp0 = 0;
-    tss.ss0 = 0x10;
-    tss.cs = 0x0B;
-    tss.ss = 0x13;
-    tss.es = 0x13;
-    tss.ds = 0x13;
-    tss.fs = 0x13;
-    tss.gs = 0x13;
+    tss->esp0 = 0;
+    tss->ss0 = 0x10;
+    tss->cs = 0x0B;
+    tss->ss = 0x13;
+    tss->es = 0x13;
+    tss->ds = 0x13;
+    tss->fs = 0x13;
+    tss->gs = 0x13;
     
     flush_tss();
 }
 
 void set_esp0(uint32_t esp) {
-    tss.esp0 = esp;
+    tss_tab[smp_cpu_id()].esp0 = esp;
 }
 
+/**
+ * TSS of the calling CPU
+ */
+tss_t *get_tss() {
+    return &tss_tab[smp_cpu_id()];
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <hal/vdso.h>
+#include <hal/clock.h>
+#include <drivers/pit.h>
+#include <proc/proc.h>
+#include <lib/string.h>
+#include <lib/math.h>
+
+static struct vdso_data *vdso = (struct vdso_data *) VDSO_DATA_ADDR;
+
+/**
+ * Fills the clock data in the common page, the programs compute the time
+ * from the TSC themselves when the clock uses it
+ */
+void vdso_init() {
+    memset(vdso, 0, sizeof(struct vdso_data));
+    clock_tsc(&vdso->tsc_khz, &vdso->tsc_base);
+}
+
+/**
+ * Publishes the time, called by the timer interrupt of the bootstrap
+ * processor only so there's a single writer
+ */
+void vdso_update(uint64_t now) {
+    uint32_t rem;
+    vdso->seq++;
+    asm volatile("" : : : "memory");
+    vdso->clock = now;
+    vdso->ticks = div64(now, TICK_NS, &rem);
+    asm volatile("" : : : "memory");
+    vdso->seq++;
+}
+
+/**
+ * Maps the per process page of a new address space, read-only for the
+ * program
+ */
+int vdso_map(page_dir_t *pdir) {
+    // The page table is shared with the rings, which the program writes
+    if(!pdir[VDSO_PROC_ADDR >> 22]) {
+        if(!vmm_create_page_table(pdir, VDSO_PROC_ADDR, PAGE_PRESENT | PAGE_RW | PAGE_USER))
+            return NULL;
+    }
+    return vmm_map(pdir, VDSO_PROC_ADDR, PAGE_PRESENT | PAGE_USER);
+}
+
+/**
+ * Writes the ids of the thread that's being switched in, its address
+ * space is the current one
+ */
+void vdso_switch(thread_t *next) {
+    process_t *proc = (process_t *) next->parent;
+    if(!proc->vdso)
+        return;
+    
+    struct vdso_proc *data = (struct vdso_proc *) VDSO_PROC_ADDR;
+    data->pid = proc->pid;
+    data->tid = next->pid;
+    data->ppid = proc->ppid;
+}
@@ -39,6 +39,8 @@ char *console_pwd();
 char *console_pwd_user();
 void print_file(file *f);
 void print_meminfo();
+void console_top();
+void console_latency(char *command);
 char *get_argument(char *command, int n);
 
 #endif
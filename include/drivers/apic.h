@@ -0,0 +1,69 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include <types.h>
+
+#define APIC_BASE_MSR           0x1B
+#define APIC_BASE_ENABLE        0x800
+#define APIC_BASE_ADDR_MASK     0xFFFFF000
+
+// Registers, offsets from the base address
+#define APIC_REG_ID             0x20
+#define APIC_REG_VERSION        0x30
+#define APIC_REG_TPR            0x80
+#define APIC_REG_EOI            0xB0
+#define APIC_REG_SPURIOUS       0xF0
+#define APIC_REG_ICR_LOW        0x300
+#define APIC_REG_ICR_HIGH       0x310
+#define APIC_REG_LVT_TIMER      0x320
+#define APIC_REG_TIMER_INIT     0x380
+#define APIC_REG_TIMER_CUR      0x390
+#define APIC_REG_TIMER_DIV      0x3E0
+
+#define APIC_SOFTWARE_ENABLE    0x100
+#define APIC_LVT_MASKED         0x10000
+#define APIC_TIMER_ONESHOT      0
+#define APIC_TIMER_PERIODIC     0x20000
+#define APIC_TIMER_DIV_16       0x3
+
+// Interrupt command register
+#define APIC_ICR_FIXED          0x4000
+#define APIC_ICR_INIT           0x4500
+#define APIC_ICR_STARTUP        0x4600
+#define APIC_ICR_PENDING        0x1000
+
+#define APIC_TIMER_INT          0x40
+#define APIC_SPURIOUS_INT       0xFF
+
+#define APIC_CALIBRATE_MS       10
+
+int apic_init();
+void apic_enable();
+int apic_available();
+uint8_t apic_id();
+void apic_send_ipi(uint8_t apic_id, uint32_t cmd);
+uint32_t apic_read(uint32_t reg);
+void apic_write(uint32_t reg, uint32_t val);
+void apic_eoi();
+void apic_timer_setup();
+uint32_t apic_timer_calibrate();
+void apic_timer_oneshot(uint32_t count);
+uint32_t apic_timer_current();
+
+#endif
@@ -17,7 +17,22 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <types.h>
+
+#define cpuid(in, a, b, c, d) asm volatile("cpuid": "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (in));
+
+#define CPUID_FEAT_EDX_FPU      (1 << 0)
+#define CPUID_FEAT_EDX_TSC      (1 << 4)
+#define CPUID_FEAT_EDX_MSR      (1 << 5)
+#define CPUID_FEAT_EDX_APIC     (1 << 9)
+#define CPUID_FEAT_EDX_SEP      (1 << 11)
+#define CPUID_FEAT_EDX_FXSR     (1 << 24)
+#define CPUID_FEAT_EDX_SSE      (1 << 25)
+
 char *get_cpu_vendor();
+int cpu_has_feature(uint32_t edx_mask);
+uint64_t cpu_rdmsr(uint32_t msr);
+void cpu_wrmsr(uint32_t msr, uint64_t value);
 
 #endif
 
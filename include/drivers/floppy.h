@@ -85,6 +85,7 @@ enum floppy_sector_dtl {
 #define FLOPPY_MSR_MASK_DATAREG             128
 
 void floppy_init();
+void floppy_irq();
 void floppy_wait_irq();
 void floppy_dma_init();
 void floppy_write_dor(uint8_t val);
@@ -93,9 +94,9 @@ void floppy_send_cmd(uint8_t cmd);
 uint8_t floppy_read_data();
 void floppy_write_ccr(uint8_t val);
 void floppy_read_sector_imp(uint8_t head, uint8_t track, uint8_t sector);
-char *floppy_read_sector(int lba);
+int floppy_read_sector(int lba, char *buf);
 int floppy_write_sector_imp(uint8_t head, uint8_t track, uint8_t sector);
-int floppy_write_sector(int lba);
+int floppy_write_sector(int lba, char *buf);
 void floppy_drive_data(uint32_t stepr, uint32_t loadt, uint32_t unloadt, int dma);
 int floppy_calibrate(uint32_t drive);
 void floppy_check_int(uint32_t * st0, uint32_t *cyl);
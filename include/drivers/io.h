@@ -27,5 +27,9 @@ extern void outportb(uint16_t port, uint8_t val);
 extern void halt();
 void enable_int();
 void disable_int();
+int disable_int_save();
+int disable_int_save_at(void *site);
+void restore_int(int flags);
+void restore_int_at(int flags, void *site);
 
 #endif
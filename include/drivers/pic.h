@@ -106,6 +106,7 @@ void pic_send_command(uint8_t cmd, uint8_t pic);
 void pic_send_data(uint8_t data, uint8_t pic);
 uint8_t pic_read_data(uint8_t pic);
 void pic_init(uint8_t base0, uint8_t base1);
+void pic_mask(uint8_t irq);
 
 #endif
 
@@ -44,16 +44,24 @@
 #define PIT_REG_COUNTER1        0x41
 #define PIT_REG_COUNTER2        0x42
 #define PIT_REG_COMMAND         0x43
+#define PIT_REG_GATE            0x61
+
+#define PIT_GATE_COUNTER2       0x1
+#define PIT_GATE_SPEAKER        0x2
+#define PIT_GATE_OUT2           0x20
+
+#define PIT_BASE_FREQUENCY      1193182
+
+#define PIT_FREQUENCY           100
+#define TICK_NS                 (1000000000 / PIT_FREQUENCY)
 
-void sched_state(int on);
-int get_sched_state();
 void pit_send_command(uint8_t cmd);
 void pit_send_data(uint16_t data, uint8_t counter);
 uint8_t pit_read_data(uint8_t counter);
 void pit_init();
 void pit_start_counter(uint32_t frequency, uint8_t counter, uint8_t mode);
-int get_tick_count();
-void reset_tick_count();
+void pit_wait(uint32_t ms);
+uint64_t get_tick_count();
 
 #endif
 
@@ -20,6 +20,8 @@
 #include <types.h>
 #include <multiboot.h>
 
+#define VIDEO_FRAME_NS  16666666    // 60 frames per second
+
 extern void int32(uint8_t intnum, regs16_t *regs);
 
 void video_init(int h, int w);
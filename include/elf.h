@@ -23,6 +23,55 @@
 
 #define EXE_MAX_SEGMENTS    9
 
+#define ELF_EXECUTABLE  1
+#define ELF_WRITABLE    2
+#define ELF_READABLE    4
+
+#define ELF_ET_EXEC     2
+#define ELF_ET_DYN      3
+
+#define ELF_PT_LOAD     1
+#define ELF_PT_DYNAMIC  2
+
+// Dynamic section tags
+#define DT_NULL         0
+#define DT_NEEDED       1
+#define DT_PLTRELSZ     2
+#define DT_HASH         4
+#define DT_STRTAB       5
+#define DT_SYMTAB       6
+#define DT_RELA         7
+#define DT_STRSZ        10
+#define DT_SYMBOLIC     16
+#define DT_REL          17
+#define DT_RELSZ        18
+#define DT_TEXTREL      22
+#define DT_JMPREL       23
+#define DT_FLAGS        30
+
+#define DF_SYMBOLIC     0x2
+#define DF_TEXTREL      0x4
+
+#define SHN_UNDEF       0
+#define STB_WEAK        2
+
+// Relocation types
+#define R_386_32        1
+#define R_386_PC32      2
+#define R_386_COPY      5
+#define R_386_GLOB_DAT  6
+#define R_386_JMP_SLOT  7
+#define R_386_RELATIVE  8
+
+#define ELF_REL_SYM(info)   ((info) >> 8)
+#define ELF_REL_TYPE(info)  ((info) & 0xFF)
+
+// Shared libraries are placed one after the other from ELF_LIB_BASE
+#define ELF_MAX_LIBS    4               // libraries an executable may need
+#define ELF_LIB_BASE    0x30000000
+#define ELF_LIB_SPAN    0x1000000       // 16MB for each library
+#define ELF_LIB_SLOTS   16
+
 #define ELF_X86     0x3
 #define ELF_X86_64  0x3E
 #define ELF_ARM     0x28
@@ -91,10 +140,64 @@ typedef struct program_header {
     uint32_t align;
 } __attribute__((__packed__)) program_header_t;
 
+typedef struct elf_dynamic {
+    int32_t tag;
+    uint32_t val;
+} __attribute__((__packed__)) elf_dynamic_t;
+
+// 16 byte
+typedef struct elf_symbol {
+    uint32_t st_name;
+    uint32_t st_value;
+    uint32_t st_size;
+    uint8_t st_info;
+    uint8_t st_other;
+    uint16_t st_shndx;
+} __attribute__((__packed__)) elf_symbol_t;
+
+typedef struct elf_rel {
+    uint32_t r_offset;
+    uint32_t r_info;
+} __attribute__((__packed__)) elf_rel_t;
+
+// A PT_LOAD segment, its pages are read from the file on their first access
+typedef struct elf_segment {
+    uint32_t vaddr;
+    uint32_t mem_size;
+    uint32_t offset;
+    uint32_t file_size;
+    uint32_t flags;
+} elf_segment_t;
+
+// An executable or a shared library
+typedef struct elf_image {
+    file f;                         // the file, positioned at its first sector
+    uint32_t version;               // of the file in the page cache
+    uint32_t base;                  // added to every address, 0 for executables
+    vmm_addr_t start;               // pages taken by the segments
+    vmm_addr_t end;
+    int segments;
+    elf_segment_t segment[EXE_MAX_SEGMENTS];
+    // Tables of the dynamic section, copied from the file
+    int symbolic;                   // its own symbols come first
+    uint32_t *hash;
+    elf_symbol_t *symtab;
+    char *strtab;
+    elf_rel_t *rel;
+    uint32_t rels;
+    elf_rel_t *jmprel;
+    uint32_t jmprels;
+    int libs;                       // libraries needed by an executable
+    struct elf_image *lib[ELF_MAX_LIBS];
+    int refs;                       // executables using a library
+    int slot;                       // where a library is, its base is taken from it
+    struct elf_image *next;         // loaded libraries
+} elf_image_t;
+
 int elf_validate(elf_header_t *eh);
-int load_elf(char *name, thread_t *thread, page_dir_t *pdir);
-int load_elf_file(char *name);
-int load_elf_relocate(thread_t *thread, page_dir_t *pdir, elf_header_t *eh);
+int load_elf(char *name, process_t *proc);
+int elf_fault(vmm_addr_t addr);
+void elf_unload(process_t *proc);
 
 #endif
 
@@ -0,0 +1,45 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <types.h>
+#include <hal/device.h>
+
+#define BUFFER_SIZE     512         // a sector
+#define BUFFER_BUCKETS  64
+#define BUFFER_MAX      128         // sectors kept in memory
+
+// A sector of a device, cached by its device and LBA
+typedef struct buffer_head {
+    device_t *dev;
+    uint32_t lba;
+    int refs;                       // users of the data, it's only reused at 0
+    int valid;                      // the data was read from the device
+    char data[BUFFER_SIZE];
+    struct buffer_head *hash_next;  // next buffer in the same bucket
+    struct buffer_head *lru_next;   // towards the least recently used
+    struct buffer_head *lru_prec;
+} buffer_head_t;
+
+buffer_head_t *buffer_read(device_t *dev, uint32_t lba);
+buffer_head_t *buffer_get(device_t *dev, uint32_t lba);
+int buffer_write(buffer_head_t *buf);
+void buffer_release(buffer_head_t *buf);
+int buffer_count();
+
+#endif
@@ -21,6 +21,7 @@
 #include <types.h>
 #include <fs/vfs.h>
 #include <hal/device.h>
+#include <fs/buffer.h>
 
 #define FAT12       0
 #define FAT16       1
@@ -93,9 +94,10 @@ void fat_mount(device_t *dev);
 void to_dos_file_name(char *name, char *str);
 void to_normal_file_name(char *name, char *str);
 uint32_t get_phys_sector(file *f);
-directory_t *fat_get_dir(file *f);
+directory_t *fat_get_dir(file *f, buffer_head_t **buf);
 int fat_touch(char *name);
 void fat_read(file *f, char *buf);
+void fat_seek(file *f, uint32_t sectors);
 void fat_write(file *f, char *str);
 int fat_delete(char *name);
 void fat_close(file *f);
@@ -21,6 +21,9 @@
 
 #define MAX_DEVICES 26
 
+// vfs_file_read fills one block at a time
+#define VFS_BLOCK_SIZE 512
+
 typedef struct {
     char name[32];
     uint32_t flags;
@@ -35,6 +38,7 @@ typedef struct {
     void (*mount) ();
     void (*read) (file *f, char *str);
     void (*write) (file *f, char *str);
+    void (*seek) (file *f, uint32_t sectors);
     void (*close) (file *f);
     file (*open) (char *name);
     void (*ls) (char *dir);
@@ -57,6 +61,7 @@ file *vfs_file_open(char *name, char *mode);
 file *vfs_file_open_user(char *name, char *mode);
 void vfs_file_read(file *f, char *str);
 void vfs_file_write(file *f, char *str);
+void vfs_file_seek(file *f, uint32_t sectors);
 void vfs_file_close(file *f);
 void vfs_file_close_user(file *f);
 int vfs_get_dev(char *name);
@@ -0,0 +1,68 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <types.h>
+
+#define ACPI_RSDP_SIGNATURE     "RSD PTR "
+#define ACPI_MADT_SIGNATURE     "APIC"
+
+#define MADT_LAPIC              0
+#define MADT_LAPIC_ENABLED      1
+
+typedef struct rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem[6];
+    uint8_t revision;
+    uint32_t rsdt;
+} __attribute__((__packed__)) rsdp_t;
+
+typedef struct sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem[6];
+    char oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator;
+    uint32_t creator_revision;
+} __attribute__((__packed__)) sdt_header_t;
+
+typedef struct madt {
+    sdt_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((__packed__)) madt_t;
+
+typedef struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((__packed__)) madt_entry_t;
+
+typedef struct madt_lapic {
+    madt_entry_t entry;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((__packed__)) madt_lapic_t;
+
+int acpi_find_cpus(uint8_t *apic_ids, int max);
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <types.h>
+#include <lib/time.h>
+
+#define CLOCK_CALIBRATE_MS      10
+
+void clock_init();
+uint64_t clock_now();
+int clock_tsc(uint32_t *khz, uint64_t *base);
+int clock_gettime_sys(int clk, struct timespec *ts);
+int nanosleep_sys(const struct timespec *req, struct timespec *rem);
+
+#endif
@@ -24,8 +24,8 @@ typedef struct device {
     int id;
     int type; // 0 floppy, 1 ata hdd
     char mount[4];
-    char* (*read) (int lba);
-    int (*write) (int lba);
+    int (*read) (int lba, char *buf);   // copies a sector into buf, -1 on error
+    int (*write) (int lba, char *buf);  // writes buf to a sector, -1 on error
     filesystem fs;
     fat_mount_info_t minfo;
 } device_t;
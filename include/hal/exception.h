@@ -25,6 +25,7 @@ void default_ir_handler();
 extern void invop_handle();
 extern void gpf_handle();
 extern void pf_handle();
+extern void nm_handle();
 extern void syscall_handle();
 
 void ex_divide_by_zero();                                   // 0
@@ -0,0 +1,37 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include <proc/thread.h>
+
+#define CR0_MP              (1 << 1)
+#define CR0_EM              (1 << 2)
+#define CR0_TS              (1 << 3)
+#define CR0_NE              (1 << 5)
+#define CR4_OSFXSR          (1 << 9)
+#define CR4_OSXMMEXCPT      (1 << 10)
+
+#define FPU_STATE_SIZE      512
+#define FPU_MXCSR_DEFAULT   0x1F80
+
+void fpu_init();
+void fpu_switch(thread_t *prev);
+void fpu_trap();
+void fpu_free(thread_t *thread);
+
+#endif
@@ -20,12 +20,15 @@
 #include <drivers/ata.h>
 #include <drivers/cpu.h>
 #include <drivers/dma.h>
+#include <hal/clock.h>
 #include <hal/device.h>
 #include <hal/exception.h>
+#include <hal/fpu.h>
 #include <drivers/floppy.h>
 #include <hal/gdt.h>
 #include <hal/idt.h>
 #include <hal/syscall.h>
+#include <hal/timer.h>
 #include <hal/tss.h>
 #include <drivers/io.h>
 #include <drivers/keyboard.h>
@@ -38,7 +41,7 @@ extern uint32_t kernel_start;
 extern uint32_t kernel_end;
 
 void hal_init();
-void sleep(int s);
+void sleep(int ms);
 void reboot();
 
 #endif
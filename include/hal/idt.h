@@ -35,6 +35,7 @@ struct idt_ptr {
 } __attribute__((__packed__));
 
 void idt_init(uint16_t code);
+void idt_load();
 void default_ir_handler();
 void install_ir(uint32_t i, uint16_t flags, uint16_t sel, void *irq);
 extern void idt_set(struct idt_ptr *ptr);
@@ -0,0 +1,44 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <types.h>
+
+#define LATENCY_IRQ         0       // interrupts disabled
+#define LATENCY_PREEMPT     1       // preemption disabled
+#define LATENCY_KINDS       2
+
+/*
+ * Longest window of a kind seen on any CPU, with the code that opened and
+ * closed it
+ */
+struct latency_window {
+    uint64_t max;                   // ns
+    void *start_site;
+    void *end_site;
+    int cpu;
+};
+
+void latency_init();
+void latency_start(int kind, void *site);
+void latency_end(int kind, void *site);
+void latency_cancel(int kind);
+void latency_get(int kind, struct latency_window *window);
+void latency_reset();
+
+#endif
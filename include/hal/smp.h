@@ -0,0 +1,52 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <types.h>
+
+#define MAX_CPUS                8
+
+// Real mode page where the application processors start
+#define SMP_TRAMPOLINE          0x9000
+
+#define SMP_RESCHED_INT         0x41
+#define SMP_TLB_INT             0x42
+
+#define TLB_FLUSH_ALL           0xFFFFFFFF
+
+typedef struct cpu {
+    int id;
+    uint8_t apic_id;
+    volatile int online;
+    uint32_t boot_stack;
+    volatile uint32_t tlb_addr;     // page to flush, or TLB_FLUSH_ALL
+    volatile int tlb_pending;
+} cpu_t;
+
+void smp_init();
+int smp_cpu_id();
+int smp_ncpus();
+cpu_t *smp_get_cpu(int id);
+void smp_ap_main();
+void smp_send_resched(int cpu);
+void smp_tlb_shootdown(uint32_t addr);
+void smp_poll();
+uint32_t smp_resched_interrupt(uint32_t esp);
+void smp_tlb_interrupt();
+
+#endif
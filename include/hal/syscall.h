@@ -19,8 +19,24 @@
 
 #include <drivers/video.h>
 
+// System call entry point in the common page at RETURN_ADDR
+#define SYSCALL_STUB_OFFSET     0x800
+#define SYSCALL_STUB            (0x400000 + SYSCALL_STUB_OFFSET)   // the clock data is at 0xC00
+
+#define MSR_SYSENTER_CS         0x174
+#define MSR_SYSENTER_ESP        0x175
+#define MSR_SYSENTER_EIP        0x176
+
+extern void sysenter_stub();
+extern void sysenter_stub_end();
+extern void int_stub();
+extern void int_stub_end();
+extern void sysenter_entry();
+
 void syscall_init();
+void sysenter_init();
 void syscall_disp();
+void sysenter_disp();
 
 #endif
 
@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <types.h>
+
+// Longest time the one-shot timer is armed for
+#define TIMER_MAX_NS            1000000000ULL
+
+// Returned by ktimer_next when no timer is pending
+#define KTIMER_NONE             0xFFFFFFFFFFFFFFFFULL
+
+/*
+ * Kernel timer, func is called from the timer interrupt once clock_now()
+ * reaches expires
+ */
+typedef struct ktimer {
+    uint64_t expires;
+    void (*func)(void *data);
+    void *data;
+    int pending;
+    int cpu;                        // queue the timer is in
+    struct ktimer *next;
+} ktimer_t;
+
+void timer_init();
+void timer_init_ap();
+int timer_is_oneshot();
+uint64_t timer_now();
+void timer_arm(uint64_t delta);
+uint32_t timer_interrupt(uint32_t esp);
+void ktimer_init(ktimer_t *timer, void (*func)(void *data), void *data);
+void ktimer_add(ktimer_t *timer, uint64_t expires);
+void ktimer_del(ktimer_t *timer);
+uint64_t ktimer_next();
+void ktimer_run(uint64_t now);
+
+#endif
@@ -51,6 +51,7 @@ typedef struct tss {
 void flush_tss();
 void install_tss();
 void set_esp0(uint32_t esp);
+tss_t *get_tss();
 
 #endif
 
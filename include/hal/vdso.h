@@ -0,0 +1,29 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef HAL_VDSO_H
+#define HAL_VDSO_H
+
+#include <types.h>
+#include <lib/vdso.h>
+#include <proc/thread.h>
+
+void vdso_init();
+void vdso_update(uint64_t now);
+int vdso_map(page_dir_t *pdir);
+void vdso_switch(thread_t *next);
+
+#endif
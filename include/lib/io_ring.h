@@ -0,0 +1,73 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "../types.h"
+
+#define IO_NOP                  0
+#define IO_READ                 1       // arg1 file, arg2 buffer
+#define IO_WRITE                2       // arg1 file, arg2 string
+#define IO_OPEN                 3       // arg1 name, arg2 mode, res is the file
+#define IO_CLOSE                4       // arg1 file
+#define IO_SLEEP                5       // arg1 low and arg2 high half of the ns
+#define IO_PRINT                6       // arg1 string
+
+#define IORING_SETUP_SQPOLL     1       // a kernel thread takes the submissions
+#define IORING_ENTER_GETEVENTS  1       // wait for min_complete completions
+#define IORING_ENTER_SQ_WAKEUP  2       // wake up the poll thread
+#define IORING_SQ_NEED_WAKEUP   1       // the poll thread went to sleep
+
+#define IORING_ADDR             0x3FF00000
+#define IORING_ENTRIES          64
+#define IORING_CQ_ENTRIES       (IORING_ENTRIES * 2)
+
+struct io_sqe {
+    uint32_t op;
+    uint32_t user_data;                 // copied to the completion
+    uint32_t arg1;
+    uint32_t arg2;
+};
+
+struct io_cqe {
+    uint32_t user_data;
+    int res;
+};
+
+/*
+ * Shared by a process and the kernel, the user produces submissions at
+ * sq_tail and consumes completions at cq_head, the kernel the opposite
+ */
+struct io_ring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    volatile uint32_t flags;
+    uint32_t setup;
+    struct io_sqe sq[IORING_ENTRIES];
+    struct io_cqe cq[IORING_CQ_ENTRIES];
+};
+
+struct io_ring *io_setup(int setup);
+int io_enter(int to_submit, int min_complete, int flags);
+int io_queue(struct io_ring *ring, uint32_t op, uint32_t arg1, uint32_t arg2, uint32_t user_data);
+int io_submit(struct io_ring *ring);
+struct io_cqe *io_peek_cqe(struct io_ring *ring);
+void io_cqe_seen(struct io_ring *ring);
+
+#endif
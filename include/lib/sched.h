@@ -0,0 +1,48 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SCHED_STATS_H
+#define SCHED_STATS_H
+
+#include "../types.h"
+
+#define SCHED_OTHER     0           // fair share of the CPU, set by nice
+#define SCHED_FIFO      1           // real-time, runs until it blocks or yields
+#define SCHED_RR        2           // real-time, takes turns with its priority
+
+/*
+ * What the scheduler knows about a thread, the times are in ns
+ */
+struct sched_stats {
+    pid_t pid;
+    char name[16];              // name of the thread's process
+    int state;
+    int nice;
+    int policy;
+    int rt_priority;            // 0 for SCHED_OTHER
+    int last_cpu;               // CPU the thread last ran on, -1 if it never ran
+    uint32_t nvcsw;             // voluntary context switches
+    uint32_t nivcsw;            // involuntary context switches
+    uint64_t user_time;         // time running in user mode
+    uint64_t kernel_time;       // time running in kernel mode
+    uint64_t wait_time;         // time runnable but waiting for the CPU
+};
+
+int getschedstats(struct sched_stats *stats, int max);
+int setscheduler(pid_t pid, int policy, int prio);
+int getscheduler(pid_t pid, int *prio);
+
+#endif
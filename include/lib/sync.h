@@ -0,0 +1,67 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "../types.h"
+#include "time.h"
+
+#define FUTEX_WAIT      0
+#define FUTEX_WAKE      1
+
+/*
+ * User space locks, they only enter the kernel when a thread has to sleep
+ * or sleeping threads have to be woken up
+ */
+typedef struct umutex {
+    volatile int state;     // 0 unlocked, 1 locked, 2 locked with waiters
+} umutex_t;
+
+typedef struct ucond {
+    volatile int seq;       // bumped by every signal
+} ucond_t;
+
+typedef struct usem {
+    volatile int value;
+    volatile int waiters;
+} usem_t;
+
+#define UMUTEX_INIT     { 0 }
+#define UCOND_INIT      { 0 }
+#define USEM_INIT(n)    { (n), 0 }
+
+int atomic_xchg(volatile int *ptr, int val);
+int atomic_cmpxchg(volatile int *ptr, int old, int val);
+int atomic_add(volatile int *ptr, int inc);
+int futex(volatile int *uaddr, int op, int val, const struct timespec *timeout);
+
+void umutex_init(umutex_t *mutex);
+int umutex_trylock(umutex_t *mutex);
+void umutex_lock(umutex_t *mutex);
+void umutex_unlock(umutex_t *mutex);
+
+void ucond_init(ucond_t *cond);
+void ucond_wait(ucond_t *cond, umutex_t *mutex);
+void ucond_signal(ucond_t *cond);
+void ucond_broadcast(ucond_t *cond);
+
+void usem_init(usem_t *sem, int value);
+int usem_trywait(usem_t *sem);
+void usem_wait(usem_t *sem);
+void usem_post(usem_t *sem);
+
+#endif
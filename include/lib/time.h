@@ -0,0 +1,40 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef TIME_H
+#define TIME_H
+
+#include "../types.h"
+
+#define CLOCK_MONOTONIC     1
+
+#define NSEC_PER_SEC        1000000000
+
+struct timespec {
+    time_t tv_sec;
+    long tv_nsec;
+};
+
+struct timeval {
+    time_t tv_sec;
+    long tv_usec;
+};
+
+int clock_gettime(int clk, struct timespec *ts);
+int gettimeofday(struct timeval *tv, void *tz);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+#endif
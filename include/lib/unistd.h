@@ -22,9 +22,20 @@
 pid_t fork();
 void exit(int code);
 pid_t wait(int *x);
+pid_t waitpid(pid_t pid, int *status);
+int execve(const char *path, char *const argv[], char *const envp[]);
+int posix_spawn(pid_t *pid, const char *path, char *const argv[]);
 //pid_t wait(pid_t proc, int *x, int code);
 pid_t getpid();
 pid_t getppid();
+pid_t gettid();
+int setpriority(pid_t pid, int prio);
+int getpriority(pid_t pid);
+int nice(int inc);
+int setaffinity(pid_t pid, uint32_t mask);
+uint32_t getaffinity(pid_t pid);
+pid_t thread_create(void *(*entry)(void *), void *arg, uint32_t stack_size);
+int thread_join(pid_t tid, void **ret);
 
 #endif
 
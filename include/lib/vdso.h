@@ -0,0 +1,50 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "../types.h"
+
+/*
+ * Pages the kernel keeps up to date for the programs, they're read-only
+ * for them so the library reads them instead of making a system call
+ */
+#define VDSO_DATA_ADDR          0x400C00    // in the common page, the same for everyone
+#define VDSO_PROC_ADDR          0x3FFFF000  // a page for every process
+
+/*
+ * Clock data, the kernel makes seq odd while it updates the rest
+ */
+struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t tsc_khz;           // TSC cycles per ms, 0 if the clock isn't the TSC
+    uint64_t tsc_base;          // TSC when the clock started
+    uint64_t clock;             // monotonic ns at the last update
+    uint64_t ticks;             // timer ticks since boot at the last update
+};
+
+/*
+ * Ids of the calling thread, written when the process is switched in. A
+ * process runs on one CPU at a time so only one of its threads can read it.
+ */
+struct vdso_proc {
+    pid_t pid;
+    pid_t tid;
+    pid_t ppid;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <mm/mm.h>
+#include <types.h>
+
+#define PAGE_CACHE_BUCKETS  64
+
+// A read-only page of an executable, shared by the processes running it
+typedef struct cached_page {
+    uint32_t dev;                   // the file is identified by its device
+    uint32_t cluster;               // and its first cluster
+    uint32_t version;               // of the file when it was read
+    vmm_addr_t vaddr;               // where the page goes in the image
+    mm_addr_t phys;
+    int refs;                       // address spaces mapping the page
+    struct cached_page *next;
+} cached_page_t;
+
+// A file that was changed, what was read from it before has an older version
+typedef struct file_version {
+    uint32_t dev;
+    uint32_t cluster;
+    uint32_t version;
+    struct file_version *next;
+} file_version_t;
+
+uint32_t page_cache_version(uint32_t dev, uint32_t cluster);
+void page_cache_invalidate(uint32_t dev, uint32_t cluster);
+mm_addr_t page_cache_get(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr);
+void page_cache_add(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr, mm_addr_t phys);
+int page_cache_put(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr, mm_addr_t phys);
+int page_cache_pages();
+
+#endif
@@ -25,6 +25,8 @@
 #define PAGE_PRESENT        0x1
 #define PAGE_RW             0x2
 #define PAGE_USER           0x4
+#define PAGE_WRITE_THROUGH  0x8
+#define PAGE_CACHE_DISABLE  0x10
 #define PAGE_ACCESSED       0x20
 #define PAGE_FRAME_MASK     0x7FFFF000
 
@@ -44,6 +46,7 @@ int vmm_create_page_table(page_dir_t *pdir, vmm_addr_t virt, uint32_t flags);
 int vmm_map(page_dir_t *pdir, vmm_addr_t virt, uint32_t flags);
 int vmm_map_phys(page_dir_t *pdir, vmm_addr_t virt, mm_addr_t phys, uint32_t flags);
 void *get_phys_addr(page_dir_t *pdir, vmm_addr_t virt);
+int vmm_user_mapped(page_dir_t *pdir, vmm_addr_t virt, uint32_t len);
 page_dir_t *create_address_space();
 void delete_address_space(page_dir_t *pdir);
 void vmm_unmap_page_table(page_dir_t *pdir, vmm_addr_t virt);
@@ -0,0 +1,77 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FAIR_H
+#define FAIR_H
+
+#include <types.h>
+
+#define NICE_MIN                -20
+#define NICE_MAX                19
+#define NICE_DEFAULT            0
+
+#define NICE_0_LOAD             1024
+
+#define SCHED_LATENCY_NS        60000000    // every runnable entity should run once in this period
+#define SCHED_MIN_GRAN_NS       10000000    // shortest slice given to an entity
+#define SCHED_WAKEUP_GRAN_NS    5000000     // vruntime advantage a woken entity needs to preempt
+
+/*
+ * Something the fair scheduler gives CPU time to: a thread inside its
+ * process, or a process among the other processes
+ */
+typedef struct sched_entity {
+    void *owner;                        // thread or process the entity belongs to
+    int nice;
+    uint32_t weight;
+    uint32_t inv_weight;                // 2^32 / weight
+    uint64_t vruntime;                  // ns spent on the CPU, scaled by the weight
+    uint64_t sum_exec;                  // ns spent on the CPU
+    uint64_t slice_start;               // sum_exec when the entity was picked
+    int on_rq;                          // runnable, either on the timeline or current
+    int red;                            // color in the timeline's red-black tree
+    struct sched_entity *left;
+    struct sched_entity *right;
+    struct sched_entity *parent;
+} sched_entity_t;
+
+/*
+ * Runnable entities in a red-black tree ordered by vruntime, the one that
+ * ran the least is the first. The current entity is kept out of the
+ * timeline while it runs.
+ */
+typedef struct timeline {
+    int nr_running;
+    uint32_t load;                      // sum of the runnable entities' weights
+    uint64_t min_vruntime;
+    sched_entity_t *root;
+    sched_entity_t *first;              // leftmost entity, cached for fair_pick
+    sched_entity_t *curr;
+} timeline_t;
+
+void fair_init_entity(sched_entity_t *se, void *owner, int nice);
+void fair_init_timeline(timeline_t *tl);
+void fair_enqueue(timeline_t *tl, sched_entity_t *se, int initial);
+void fair_dequeue(timeline_t *tl, sched_entity_t *se);
+sched_entity_t *fair_pick(timeline_t *tl);
+void fair_put(timeline_t *tl, sched_entity_t *se);
+void fair_update(timeline_t *tl, sched_entity_t *se, uint32_t delta);
+void fair_reweight(timeline_t *tl, sched_entity_t *se, int nice);
+uint64_t fair_slice(timeline_t *tl, sched_entity_t *se, uint64_t period);
+int fair_wakeup_preempt(sched_entity_t *curr, sched_entity_t *se);
+void fair_migrate(timeline_t *from, timeline_t *to, sched_entity_t *se);
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <types.h>
+#include <lib/time.h>
+
+#define FUTEX_WAIT      0
+#define FUTEX_WAKE      1
+
+#define FUTEX_HASH_SIZE 64
+
+int futex_sys(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout);
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PROC_IO_RING_H
+#define PROC_IO_RING_H
+
+#include <lib/io_ring.h>
+#include <proc/proc.h>
+
+// Time the poll thread keeps polling an empty ring before sleeping
+#define IORING_IDLE_NS      1000000
+
+typedef struct io_ctx {
+    struct io_ring *ring;       // mapped at IORING_ADDR in the process
+    mutex_t lock;               // one consumer of the submissions at a time
+    wait_queue_t cq_wait;       // threads waiting for completions
+    wait_queue_t sq_wait;       // the poll thread when it's asleep
+    thread_t *poller;
+} io_ctx_t;
+
+struct io_ring *io_setup_sys(int setup);
+int io_enter_sys(int to_submit, int min_complete, int flags);
+void io_ring_free(process_t *proc);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <proc/spinlock.h>
+#include <proc/wait.h>
+
+/*
+ * Sleeping lock, the threads that can't take it block on its wait queue.
+ * It can't be used from interrupt handlers.
+ */
+typedef struct mutex {
+    volatile uint32_t locked;       // not a spinlock, the owner can sleep
+    thread_t *owner;
+    wait_queue_t wait;
+} mutex_t;
+
+#define MUTEX_INIT      { 0, NULL, WAIT_QUEUE_INIT }
+
+void mutex_init(mutex_t *mutex);
+int mutex_trylock(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PID_H
+#define PID_H
+
+#include <types.h>
+#include <proc/thread.h>
+
+#define PID_MAX         32768
+#define PID_HASH_SIZE   256
+
+int pid_alloc();
+void pid_free(int pid);
+void pid_hash_add(thread_t *thread);
+void pid_hash_remove(thread_t *thread);
+thread_t *pid_lookup(int pid);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <types.h>
+
+/*
+ * Every CPU counts the critical sections it's in, the timer switches away
+ * from kernel code only when the count is 0. It starts at 1 and the
+ * scheduler clears it when the CPU starts running threads.
+ */
+void preempt_disable();
+void preempt_enable();
+void preempt_enable_no_resched();
+void preempt_disable_at(void *site);
+void preempt_enable_at(void *site, int resched);
+int preempt_count();
+void preempt_start();
+
+#endif
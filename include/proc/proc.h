@@ -21,15 +21,21 @@
 #include <mm/memory.h>
 #include <types.h>
 #include <proc/thread.h>
+#include <proc/wait.h>
+#include <proc/mutex.h>
 
 #define PROC_NULL       -1
 
 #define PROC_STOPPED    0
 #define PROC_ACTIVE     1
 #define PROC_NEW        2
+#define PROC_BLOCKED    3
+#define PROC_ZOMBIE     4
 
 #define RETURN_ADDR 0x400000
 
+#define PROC_ARG_MAX    4096        // bytes of path and arguments execve and posix_spawn copy
+
 struct regs {
     uint32_t ds;
     uint32_t es;
@@ -67,23 +73,80 @@ struct regs_error {
 
 typedef struct proc {
     char name[16];
+    pid_t pid;                      // id of the main thread
     int state;
+    int exit_code;
     page_dir_t *pdir;
     int threads;
     thread_t *thread_list;
+    int cpu;                        // CPU the process runs on
+    uint32_t affinity;              // CPUs the process may run on, one bit each
+    sched_entity_t se;              // process' share of the CPU time
+    timeline_t timeline;            // runnable threads of the process
+    wait_queue_t wait;              // threads waiting for the process or one of its threads to end
+    uint32_t thread_slots;          // thread_create slots in use, one bit each
+    mutex_t heap_lock;              // the threads of the process may share a heap
+    struct io_ctx *io;              // submission and completion rings
+    struct elf_image *image;        // segments of the executable, loaded on first access
+    mutex_t image_lock;             // page faults of the threads fill the image one at a time
+    pid_t ppid;                     // id of the parent, 0 once it's gone
+    int vdso;                       // the ids are published at VDSO_PROC_ADDR
+    struct proc *parent;            // process that started it, NULL once that one is gone
+    struct proc *children;          // processes it started, running or zombie
+    struct proc *sibling;           // next child of the same parent
+    struct proc *reap_next;         // next process waiting for the reaper
+    int reaped;                     // only the exit status is left
+    uint32_t child_events;          // bumped every time a child is reaped
+    wait_queue_t child_wait;        // threads in waitpid
+    struct old_space *old_space;    // address space execve is leaving
     struct proc *next;
     struct proc *prec;
 } process_t;
 
+/**
+ * Address space replaced by execve, the reaper frees it
+ */
+typedef struct old_space {
+    page_dir_t *pdir;
+    vmm_addr_t stack;               // kernel stack execve ran on
+    struct old_space *next;
+} old_space_t;
+
+/**
+ * Work for the loader, kept in the kernel heap as the loader can't see
+ * the stack of the caller
+ */
+typedef struct load_request {
+    char **args;                    // argument vector, the path follows its NULL
+    process_t *parent;              // parent of the new process
+    process_t *space;               // if set, only the address space is built, for execve
+    int ret;
+    int done;
+    wait_queue_t wait;
+    struct load_request *next;
+} load_request_t;
+
 extern void end_process();
+extern void exec_switch(page_dir_t *pdir, uint32_t esp);
+extern mutex_t proc_lock;
 
 int start_proc(char *name, char *arguments);
 int build_stack(thread_t *thread, page_dir_t *pdir, int nthreads);
-int heap_fill(thread_t *thread, char *name, char *arguments, uint32_t *argc, uint32_t *argv1);
+int heap_fill(thread_t *thread, char **args, uint32_t *argc, uint32_t *argv1);
 int stack_fill(thread_t *thread, uint32_t argc, uint32_t argv);
+void kernel_stack_fill(thread_t *thread);
 int build_heap(thread_t *thread, page_dir_t *pdir, int nthreads);
 void end_proc(int ret);
-void remove_proc(int pid);
+void proc_reaper();
+void proc_reap_thread(thread_t *thread);
+void proc_loader();
+void args_free(char **args);
+int posix_spawn_sys(char *path, char **argv);
+int execve_sys(char *path, char **argv);
+void exec_finish();
+int waitpid_sys(int pid, int *status);
+int getpid_sys();
+int getppid_sys();
 int start_kernel_proc(char *name, void *addr);
 int proc_state(int id);
 
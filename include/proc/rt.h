@@ -0,0 +1,63 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RT_H
+#define RT_H
+
+#include <types.h>
+
+#define RT_PRIO_MAX             32          // real-time priorities go from 1 to RT_PRIO_MAX - 1
+#define RT_RR_SLICE_NS          100000000   // time a SCHED_RR thread runs before the next one of its priority
+#define RT_PERIOD_NS            1000000000
+#define RT_RUNTIME_NS           950000000   // real-time threads can't take more than this in a period
+
+/*
+ * Real-time part of a thread, a runnable real-time thread always runs
+ * before the fair ones
+ */
+typedef struct rt_entity {
+    void *owner;                        // thread the entity belongs to
+    int policy;                         // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int prio;
+    uint64_t slice;                     // ns left of the SCHED_RR slice
+    int on_rq;
+    struct rt_entity *next;
+    struct rt_entity *prec;
+} rt_entity_t;
+
+/*
+ * A FIFO list of runnable entities for every priority, the running entity
+ * stays at the head of its list
+ */
+typedef struct rt_queue {
+    int nr_running;
+    uint32_t bitmap;                    // bit n is set if the list of priority n isn't empty
+    rt_entity_t *first[RT_PRIO_MAX];
+    rt_entity_t *last[RT_PRIO_MAX];
+    uint64_t time;                      // ns the entities ran in the current period
+    uint64_t period_start;
+    int throttled;                      // the period's runtime is over, the fair threads run
+} rt_queue_t;
+
+void rt_init_entity(rt_entity_t *rt, void *owner);
+void rt_init_queue(rt_queue_t *q);
+void rt_enqueue(rt_queue_t *q, rt_entity_t *rt);
+void rt_dequeue(rt_queue_t *q, rt_entity_t *rt);
+void rt_requeue(rt_queue_t *q, rt_entity_t *rt);
+rt_entity_t *rt_next(rt_queue_t *q, rt_entity_t *rt);
+int rt_preempt(rt_entity_t *curr, rt_entity_t *rt);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <proc/spinlock.h>
+
+/*
+ * Spinning lock held by many readers or by one writer, the holders can't
+ * be preempted and must not sleep
+ */
+typedef struct rwlock {
+    spinlock_t lock;
+    volatile int readers;
+    volatile int writer;
+} rwlock_t;
+
+#define RWLOCK_INIT     { SPINLOCK_INIT, 0, 0 }
+
+void rwlock_init(rwlock_t *rw);
+void read_lock(rwlock_t *rw);
+void read_unlock(rwlock_t *rw);
+void write_lock(rwlock_t *rw);
+void write_unlock(rwlock_t *rw);
+
+#endif
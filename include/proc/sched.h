@@ -18,13 +18,68 @@
 #define SCHED_H
 
 #include <proc/proc.h>
+#include <proc/fair.h>
+#include <hal/smp.h>
+#include <lib/sched.h>
+
+#define SCHED_YIELD_INT     0x71
+
+#define SCHED_ALL_CPUS      0xFFFFFFFF
+
+/*
+ * The CPU time is shared fairly between the processes with runnable
+ * threads, then each process shares its part between its threads.
+ * Runnable real-time threads run before all of them, until they use up
+ * their runtime in the period.
+ * Every CPU has its own run queue, a process runs only on proc->cpu.
+ */
+typedef struct runqueue {
+    int cpu;
+    int nr_procs;                   // processes assigned to the CPU
+    int nr_running;                 // fair and real-time threads
+    int need_resched;
+    int preempting;                 // the yield comes from preempt_enable, it's not voluntary
+    thread_t *current;
+    thread_t *last;                 // switched out, the CPU may still be on its stack
+    process_t *push;                // not allowed here anymore, moves on the next switch
+    thread_t *idle;                 // runs when nothing else can
+    uint64_t idle_time;             // ns spent in the idle thread
+    uint64_t clock;                 // time of the last accounting, in ns
+    timeline_t timeline;
+    rt_queue_t rt;
+} runqueue_t;
 
 process_t *get_cur_proc();
+thread_t *get_cur_thread();
 process_t *get_proc_by_id(int id);
+thread_t *get_thread_by_id(int id);
 uint32_t schedule(uint32_t esp);
+uint32_t sched_switch(uint32_t esp);
+void sched_yield();
+void sched_preempt();
+void sched_wake(thread_t *thread);
+void sched_sleep(uint64_t ns);
+void sched_stop_thread(thread_t *thread);
+uint64_t sched_slice(thread_t *thread);
+uint64_t sched_idle_time();
+int sched_getstats(struct sched_stats *stats, int max);
+void sched_init_proc(process_t *proc, int nice);
+void sched_init_thread(thread_t *thread, int nice);
+void sched_enqueue(thread_t *thread);
+void sched_dequeue(thread_t *thread);
+int sched_setpriority(int pid, int nice);
+int sched_getpriority(int pid);
+int sched_setscheduler(int pid, int policy, int prio);
+int sched_getscheduler(int pid, int *prio);
+int sched_setaffinity(int pid, uint32_t mask);
+uint32_t sched_getaffinity(int pid);
 void sched_add_proc(process_t *proc);
 void sched_remove_proc(int id);
+int sched_proc_running(process_t *proc);
+int sched_thread_running(thread_t *thread);
+void sched_remove_thread(thread_t *thread);
 void sched_init();
+void sched_init_ap();
 int get_nproc();
 void print_procs();
 
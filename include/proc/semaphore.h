@@ -0,0 +1,37 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include <proc/spinlock.h>
+#include <proc/wait.h>
+
+/*
+ * Counting semaphore, sem_down blocks while the count is 0
+ */
+typedef struct semaphore {
+    spinlock_t lock;
+    int count;
+    wait_queue_t wait;
+} semaphore_t;
+
+void sem_init(semaphore_t *sem, int count);
+int sem_trydown(semaphore_t *sem);
+void sem_down(semaphore_t *sem);
+void sem_up(semaphore_t *sem);
+
+#endif
@@ -18,10 +18,44 @@
 #define THREAD_H
 
 #include <types.h>
+#include <proc/fair.h>
+#include <proc/rt.h>
+#include <hal/timer.h>
+#include <mm/paging.h>
+
+/*
+ * Threads made by thread_create live in a slot of the process' address
+ * space, the bottom of the slot stays unmapped as a guard
+ * |----THREAD_SLOTS_START + slot * THREAD_SLOT_SIZE----|
+ * |                   guard                            |
+ * |-------------------stack_base-----------------------|
+ * |              user stack, stack_size B              |
+ * |-------------------stack_limit----------------------|
+ * |               kernel stack, 4096B                  |
+ * |----------------stack_kernel_limit------------------|
+ */
+#define THREAD_SLOTS_START      0x40000000
+#define THREAD_SLOT_SIZE        0x100000
+#define THREAD_MAX_SLOTS        32
+#define THREAD_STACK_DEFAULT    0x4000
+#define THREAD_STACK_MAX        (THREAD_SLOT_SIZE - 2 * PAGE_SIZE)
+
+/*
+ * Scheduler accounting of a thread, the run time is charged to the mode
+ * the thread was in when it's accounted
+ */
+typedef struct thread_stats {
+    uint64_t user_time;
+    uint64_t kernel_time;
+    uint64_t wait_time;
+    uint64_t wait_start;            // when the thread last started waiting for the CPU
+    uint32_t nvcsw;
+    uint32_t nivcsw;
+    int last_cpu;
+} thread_stats_t;
 
 typedef struct thread {
     pid_t pid;                      // thread id
-    int time;                       // thread's time slice in ms
     int main;                       // if it's the main thread
     int state;                      // thread's state
     void *parent;                   // pointer to proc
@@ -30,10 +64,24 @@ typedef struct thread {
     uint32_t stack_limit;           // thread's stack limit pointer
     uint32_t esp_kernel;            // thread's kernel stack pointer
     uint32_t stack_kernel_limit;    // thread's kernel stack limit
+    uint32_t stack_base;            // lowest user stack address of a slot thread
+    int slot;                       // thread_create slot, -1 for the others
+    int exit_code;                  // value passed to exit
+    int joined;                     // someone is already in thread_join
     uint32_t heap;                  // thread's heap pointer
     uint32_t heap_limit;            // thread's heap limit pointer
     uint32_t image_base;
     uint32_t image_size;
+    sched_entity_t se;              // thread's share of its process' CPU time
+    rt_entity_t rt;                 // real-time policy and priority
+    thread_stats_t stats;           // where the thread's time went
+    struct wait_queue *waiting_on;  // wait queue the thread is in
+    struct thread *wait_next;       // next thread in the same wait queue
+    struct thread *reap_next;       // next stopped thread waiting for the reaper
+    uint32_t wait_key;              // event waited for in a shared queue
+    struct thread *pid_next;        // next thread in the same pid hash bucket
+    ktimer_t sleep_timer;           // wakes the thread up from sched_sleep
+    void *fpu_state;                // FPU/SSE registers, allocated on first use
     struct thread *next;
     struct thread *prec;
 } thread_t;
@@ -41,6 +89,10 @@ typedef struct thread {
 thread_t *create_thread();
 int start_thread();
 void stop_thread(int code);
+int thread_create_sys(void *start, void *entry, void *arg, uint32_t stack_size);
+int thread_join_sys(int tid, int *ret);
+thread_t *thread_create_kernel(void (*func)());
+void thread_free(thread_t *thread, page_dir_t *pdir);
 
 #endif
 
@@ -0,0 +1,60 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <proc/thread.h>
+#include <proc/spinlock.h>
+
+/*
+ * Threads blocked until an event happens, in the order they went to sleep
+ */
+typedef struct wait_queue {
+    spinlock_t lock;
+    thread_t *head;
+    thread_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT     { SPINLOCK_INIT, NULL, NULL }
+
+/*
+ * Blocks the calling thread until cond is true. The thread is queued
+ * before the condition is checked, so a wake up from another CPU can't
+ * get lost between the check and the sleep.
+ */
+#define wait_event(queue, cond)                 \
+    do {                                        \
+        while(1) {                              \
+            prepare_to_wait(queue);             \
+            if(cond)                            \
+                break;                          \
+            sched_block();                      \
+        }                                       \
+        finish_wait(queue);                     \
+    } while(0)
+
+void wait_queue_init(wait_queue_t *queue);
+void prepare_to_wait(wait_queue_t *queue);
+void finish_wait(wait_queue_t *queue);
+void wait_cancel(thread_t *thread);
+void sleep_on(wait_queue_t *queue);
+void wake_up(wait_queue_t *queue);
+void wake_up_all(wait_queue_t *queue);
+int wake_up_key(wait_queue_t *queue, uint32_t key, int nr);
+void sched_block();
+
+#endif
@@ -32,6 +32,7 @@ typedef signed long long int64_t;
 typedef unsigned int size_t;
 
 typedef int pid_t;
+typedef long time_t;
 
 typedef struct regs16 {
     uint16_t di;
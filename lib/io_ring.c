@@ -0,0 +1,79 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <lib/io_ring.h>
+#include <lib/system_calls.h>
+
+// Submissions queued since the last io_submit
+static int io_pending;
+
+/* Maps the rings of the process, setup can ask for a poll thread */
+struct io_ring *io_setup(int setup) {
+    asm volatile("mov %0, %%ebx" : : "b" (setup));
+    return (struct io_ring *) syscall_call(21);
+}
+
+/* Runs up to to_submit submissions, or wakes the poll thread, and waits for completions */
+int io_enter(int to_submit, int min_complete, int flags) {
+    asm volatile("mov %0, %%ebx" : : "b" (to_submit));
+    asm volatile("mov %0, %%ecx" : : "c" (min_complete));
+    asm volatile("mov %0, %%edx" : : "d" (flags));
+    return (int) syscall_call(22);
+}
+
+/* Adds a submission, returns 0 if the queue is full */
+int io_queue(struct io_ring *ring, uint32_t op, uint32_t arg1, uint32_t arg2, uint32_t user_data) {
+    uint32_t tail = ring->sq_tail;
+    if(tail - ring->sq_head >= IORING_ENTRIES)
+        return 0;
+    
+    struct io_sqe *sqe = &ring->sq[tail & (IORING_ENTRIES - 1)];
+    sqe->op = op;
+    sqe->arg1 = arg1;
+    sqe->arg2 = arg2;
+    sqe->user_data = user_data;
+    // The entry must be complete before the kernel sees it
+    asm volatile("" : : : "memory");
+    ring->sq_tail = tail + 1;
+    io_pending++;
+    return 1;
+}
+
+/* Hands the queued submissions to the kernel with at most one system call */
+int io_submit(struct io_ring *ring) {
+    int n = io_pending;
+    io_pending = 0;
+    if(!(ring->setup & IORING_SETUP_SQPOLL))
+        return io_enter(n, 0, 0);
+    
+    // The poll thread finds them by itself unless it's asleep
+    asm volatile("lock; addl $0, (%%esp)" : : : "memory");
+    if(ring->flags & IORING_SQ_NEED_WAKEUP)
+        io_enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+    return n;
+}
+
+/* First completion not seen yet, NULL if there's none */
+struct io_cqe *io_peek_cqe(struct io_ring *ring) {
+    uint32_t head = ring->cq_head;
+    if(head == ring->cq_tail)
+        return NULL;
+    return &ring->cq[head & (IORING_CQ_ENTRIES - 1)];
+}
+
+void io_cqe_seen(struct io_ring *ring) {
+    ring->cq_head++;
+}
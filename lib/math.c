@@ -0,0 +1,39 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <lib/math.h>
+
+/**
+ * Divides a 64 bit number by a 32 bit one without the compiler runtime
+ */
+uint64_t div64(uint64_t n, uint32_t base, uint32_t *rem) {
+    uint32_t high = (uint32_t) (n >> 32);
+    uint32_t low = (uint32_t) n;
+    uint32_t quot_high = 0;
+    uint32_t r;
+    
+    // divl faults if the quotient doesn't fit in 32 bits, so split the division
+    if(high >= base) {
+        quot_high = high / base;
+        high %= base;
+    }
+    asm volatile("divl %2" : "=a" (low), "=d" (r) : "rm" (base), "0" (low), "1" (high));
+    
+    if(rem)
+        *rem = r;
+    return ((uint64_t) quot_high << 32) | low;
+}
+
@@ -0,0 +1,126 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <lib/sync.h>
+#include <lib/system_calls.h>
+
+/* Stores val in *ptr and returns the old value */
+int atomic_xchg(volatile int *ptr, int val) {
+    asm volatile("xchg %0, %1" : "+r" (val), "+m" (*ptr) : : "memory");
+    return val;
+}
+
+/* Stores val in *ptr if it's old, returns the value found */
+int atomic_cmpxchg(volatile int *ptr, int old, int val) {
+    asm volatile("lock cmpxchg %2, %1" : "+a" (old), "+m" (*ptr) : "r" (val) : "memory");
+    return old;
+}
+
+/* Adds inc to *ptr and returns the old value */
+int atomic_add(volatile int *ptr, int inc) {
+    asm volatile("lock xadd %0, %1" : "+r" (inc), "+m" (*ptr) : : "memory");
+    return inc;
+}
+
+/* Sleeps while *uaddr is val or wakes up val threads sleeping on uaddr */
+int futex(volatile int *uaddr, int op, int val, const struct timespec *timeout) {
+    asm volatile("mov %0, %%ebx" : : "b" (uaddr));
+    asm volatile("mov %0, %%ecx" : : "c" (op));
+    asm volatile("mov %0, %%edx" : : "d" (val));
+    asm volatile("mov %0, %%esi" : : "S" (timeout));
+    return (int) syscall_call(17);
+}
+
+void umutex_init(umutex_t *mutex) {
+    mutex->state = 0;
+}
+
+/* Takes the mutex if it's free, returns 1 on success */
+int umutex_trylock(umutex_t *mutex) {
+    return atomic_cmpxchg(&mutex->state, 0, 1) == 0;
+}
+
+void umutex_lock(umutex_t *mutex) {
+    int c = atomic_cmpxchg(&mutex->state, 0, 1);
+    if(c == 0)
+        return;
+    
+    // Contended, mark it so the owner wakes us up on unlock
+    if(c != 2)
+        c = atomic_xchg(&mutex->state, 2);
+    while(c != 0) {
+        futex(&mutex->state, FUTEX_WAIT, 2, NULL);
+        c = atomic_xchg(&mutex->state, 2);
+    }
+}
+
+void umutex_unlock(umutex_t *mutex) {
+    if(atomic_xchg(&mutex->state, 0) == 2)
+        futex(&mutex->state, FUTEX_WAKE, 1, NULL);
+}
+
+void ucond_init(ucond_t *cond) {
+    cond->seq = 0;
+}
+
+/* Releases the mutex and sleeps until signaled, the mutex is held again on return */
+void ucond_wait(ucond_t *cond, umutex_t *mutex) {
+    int seq = cond->seq;
+    umutex_unlock(mutex);
+    futex(&cond->seq, FUTEX_WAIT, seq, NULL);
+    umutex_lock(mutex);
+}
+
+void ucond_signal(ucond_t *cond) {
+    atomic_add(&cond->seq, 1);
+    futex(&cond->seq, FUTEX_WAKE, 1, NULL);
+}
+
+void ucond_broadcast(ucond_t *cond) {
+    atomic_add(&cond->seq, 1);
+    futex(&cond->seq, FUTEX_WAKE, 0x7FFFFFFF, NULL);
+}
+
+void usem_init(usem_t *sem, int value) {
+    sem->value = value;
+    sem->waiters = 0;
+}
+
+/* Decrements the semaphore if it's positive, returns 1 on success */
+int usem_trywait(usem_t *sem) {
+    int value = sem->value;
+    while(value > 0) {
+        int old = atomic_cmpxchg(&sem->value, value, value - 1);
+        if(old == value)
+            return 1;
+        value = old;
+    }
+    return 0;
+}
+
+void usem_wait(usem_t *sem) {
+    while(!usem_trywait(sem)) {
+        atomic_add(&sem->waiters, 1);
+        futex(&sem->value, FUTEX_WAIT, 0, NULL);
+        atomic_add(&sem->waiters, -1);
+    }
+}
+
+void usem_post(usem_t *sem) {
+    atomic_add(&sem->value, 1);
+    if(sem->waiters)
+        futex(&sem->value, FUTEX_WAKE, 1, NULL);
+}
@@ -16,6 +16,7 @@
  
 #include <lib/string.h>
 #include <lib/system_calls.h>
+#include <hal/syscall.h>
 
 void system(char *arg) {
     if(strcmp(arg, "clear") == 0) {
@@ -32,10 +33,14 @@ void end_process_return() {
     syscall_call(5);
 }
 
+// The stub is put in the common page by the kernel, it uses sysenter if the CPU has it.
+// Its address is pushed as an immediate so libc.so needs no text relocation.
 void *syscall_call(int n) {
     void *ret;
     asm volatile("mov %0, %%eax; \
-	              int $0x72" : : "a" (n));
+	              push %1; \
+	              call *(%%esp); \
+	              add $4, %%esp" : : "a" (n), "i" (SYSCALL_STUB));
     asm volatile("mov %%eax, %0" : "=r" (ret));
     return ret;
 }
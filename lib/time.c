@@ -0,0 +1,75 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <lib/time.h>
+#include <lib/vdso.h>
+#include <lib/math.h>
+#include <lib/system_calls.h>
+
+/* Nanoseconds since boot, read from the kernel's clock page without a system call */
+static uint64_t vdso_clock() {
+    struct vdso_data *vdso = (struct vdso_data *) VDSO_DATA_ADDR;
+    uint32_t seq, khz;
+    uint64_t base, clock;
+    
+    // Try again if the kernel was updating it
+    do {
+        seq = vdso->seq;
+        asm volatile("" : : : "memory");
+        khz = vdso->tsc_khz;
+        base = vdso->tsc_base;
+        clock = vdso->clock;
+        asm volatile("" : : : "memory");
+    } while((seq & 1) || (seq != vdso->seq));
+    
+    if(khz == 0)
+        return clock;
+    
+    uint32_t lo, hi, rem, rem_ns;
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    uint64_t ms = div64((((uint64_t) hi << 32) | lo) - base, khz, &rem);
+    return ms * 1000000 + div64((uint64_t) rem * 1000000, khz, &rem_ns);
+}
+
+/* Reads a clock, only CLOCK_MONOTONIC is supported */
+int clock_gettime(int clk, struct timespec *ts) {
+    if((clk != CLOCK_MONOTONIC) || (ts == NULL))
+        return -1;
+    
+    uint32_t nsec;
+    ts->tv_sec = (time_t) div64(vdso_clock(), NSEC_PER_SEC, &nsec);
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
+/* Time since boot in microseconds, there's no wall clock */
+int gettimeofday(struct timeval *tv, void *tz) {
+    (void) tz;
+    if(tv == NULL)
+        return -1;
+    
+    uint32_t nsec;
+    tv->tv_sec = (time_t) div64(vdso_clock(), NSEC_PER_SEC, &nsec);
+    tv->tv_usec = nsec / 1000;
+    return 0;
+}
+
+/* Suspends the calling thread for the requested time */
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    asm volatile("mov %0, %%ebx" : : "b" (req));
+    asm volatile("mov %0, %%ecx" : : "c" (rem));
+    return (int) syscall_call(14);
+}
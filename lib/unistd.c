@@ -17,6 +17,8 @@
 #include <hal/hal.h>
 #include <lib/string.h>
 #include <lib/unistd.h>
+#include <lib/sched.h>
+#include <lib/vdso.h>
 #include <lib/system_calls.h>
 #include <proc/proc.h>
 #include <proc/sched.h>
@@ -32,10 +34,35 @@ void exit(int code) {
     syscall_call(4);
 }
 
-/* Waits until a thread ends */
+/* Waits until one of the child processes ends, returns its pid */
 pid_t wait(int *x) {
-    // TODO implement
-    x = x;
+    return waitpid(-1, x);
+}
+
+/* Waits until the child process pid ends, -1 means any child */
+pid_t waitpid(pid_t pid, int *status) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    asm volatile("mov %0, %%ecx" : : "c" (status));
+    return (pid_t) syscall_call(23);
+}
+
+/* Replaces the program of the calling process, there's no environment so envp is ignored */
+int execve(const char *path, char *const argv[], char *const envp[]) {
+    (void) envp;
+    asm volatile("mov %0, %%ebx" : : "b" (path));
+    asm volatile("mov %0, %%ecx" : : "c" (argv));
+    return (int) syscall_call(28);
+}
+
+/* Starts the program at path as a child, pid gets its id */
+int posix_spawn(pid_t *pid, const char *path, char *const argv[]) {
+    asm volatile("mov %0, %%ebx" : : "b" (path));
+    asm volatile("mov %0, %%ecx" : : "c" (argv));
+    pid_t ret = (pid_t) syscall_call(29);
+    if(ret < 0)
+        return -1;
+    if(pid)
+        *pid = ret;
     return 0;
 }
 
@@ -44,13 +71,94 @@ pid_t wait(pid_t proc, int *x, int code) {
     return 0;
 }*/
 
-/* Gets the thread's pid */
+/* Gets the process' pid, from the kernel's page without a system call */
 pid_t getpid() {
-    return 0;
+    return ((struct vdso_proc *) VDSO_PROC_ADDR)->pid;
+}
+
+/* Gets the calling thread's id */
+pid_t gettid() {
+    return ((struct vdso_proc *) VDSO_PROC_ADDR)->tid;
 }
 
-/* Gets the parent's pid */
+/* Gets the parent's pid, 0 once it's gone */
 pid_t getppid() {
-    return 0;
+    return ((struct vdso_proc *) VDSO_PROC_ADDR)->ppid;
+}
+
+/* Sets the nice value of a thread, 0 means the calling thread */
+int setpriority(pid_t pid, int prio) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    asm volatile("mov %0, %%ecx" : : "c" (prio));
+    return (int) syscall_call(11);
+}
+
+/* Gets the nice value of a thread, 0 means the calling thread */
+int getpriority(pid_t pid) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    return (int) syscall_call(12);
+}
+
+/* Adds inc to the nice value of the calling thread */
+int nice(int inc) {
+    int prio = getpriority(0) + inc;
+    if(setpriority(0, prio) < 0)
+        return -1;
+    return getpriority(0);
 }
 
+/* Restricts the process of a thread to a set of CPUs, one bit each */
+int setaffinity(pid_t pid, uint32_t mask) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    asm volatile("mov %0, %%ecx" : : "c" (mask));
+    return (int) syscall_call(15);
+}
+
+/* Gets the CPUs the process of a thread may run on */
+uint32_t getaffinity(pid_t pid) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    return (uint32_t) syscall_call(16);
+}
+
+/* First function of a thread made by thread_create */
+static void thread_start(void *(*entry)(void *), void *arg) {
+    exit((int) entry(arg));
+}
+
+/* Starts a thread running entry(arg) on a stack of stack_size bytes, 0 for the default */
+pid_t thread_create(void *(*entry)(void *), void *arg, uint32_t stack_size) {
+    asm volatile("mov %0, %%ebx" : : "b" (&thread_start));
+    asm volatile("mov %0, %%ecx" : : "c" (entry));
+    asm volatile("mov %0, %%edx" : : "d" (arg));
+    asm volatile("mov %0, %%esi" : : "S" (stack_size));
+    return (pid_t) syscall_call(18);
+}
+
+/* Waits until a thread made by thread_create ends, ret gets what its function returned */
+int thread_join(pid_t tid, void **ret) {
+    asm volatile("mov %0, %%ebx" : : "b" (tid));
+    asm volatile("mov %0, %%ecx" : : "c" (ret));
+    return (int) syscall_call(19);
+}
+
+/* Copies the scheduler statistics of up to max threads, returns how many */
+int getschedstats(struct sched_stats *stats, int max) {
+    asm volatile("mov %0, %%ebx" : : "b" (stats));
+    asm volatile("mov %0, %%ecx" : : "c" (max));
+    return (int) syscall_call(20);
+}
+
+/* Puts a thread in SCHED_OTHER, SCHED_FIFO or SCHED_RR, 0 means the calling one */
+int setscheduler(pid_t pid, int policy, int prio) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    asm volatile("mov %0, %%ecx" : : "c" (policy));
+    asm volatile("mov %0, %%edx" : : "d" (prio));
+    return (int) syscall_call(26);
+}
+
+/* Returns the scheduling class of a thread, prio gets its real-time priority */
+int getscheduler(pid_t pid, int *prio) {
+    asm volatile("mov %0, %%ebx" : : "b" (pid));
+    asm volatile("mov %0, %%ecx" : : "c" (prio));
+    return (int) syscall_call(27);
+}
@@ -83,16 +83,23 @@ void ufree(void *ptr, vmm_addr_t *heap) {
 }
 
 void *umalloc_sys(size_t len) {
-    process_t *cur = get_cur_proc();
-    if(cur && cur->thread_list) {
-        return umalloc(len, (vmm_addr_t *) cur->thread_list->heap);
+    thread_t *cur = get_cur_thread();
+    if(cur) {
+        process_t *proc = (process_t *) cur->parent;
+        mutex_lock(&proc->heap_lock);
+        void *ptr = umalloc(len, (vmm_addr_t *) cur->heap);
+        mutex_unlock(&proc->heap_lock);
+        return ptr;
     }
     return NULL;
 }
 
 void ufree_sys(void *ptr) {
-    process_t *cur = get_cur_proc();
-    if(cur && cur->thread_list) {
-        ufree(ptr, (vmm_addr_t *) cur->thread_list->heap);
+    thread_t *cur = get_cur_thread();
+    if(cur) {
+        process_t *proc = (process_t *) cur->parent;
+        mutex_lock(&proc->heap_lock);
+        ufree(ptr, (vmm_addr_t *) cur->heap);
+        mutex_unlock(&proc->heap_lock);
     }
 }
@@ -18,11 +18,13 @@
 #include <mm/kheap.h>
 #include <mm/mm.h>
 #include <mm/paging.h>
+#include <proc/spinlock.h>
 #include <drivers/video.h>
 
 #define HEAP_END 0x200000
 
 heap_info_t heap_info;
+static spinlock_t heap_lock = SPINLOCK_INIT;
 
 /**
  * Init the kernel heap memory
@@ -39,10 +41,14 @@ void kheap_init() {
 }
 
 void *kmalloc(size_t len) {
-    return first_free(len);
+    int flags = spin_lock_irqsave(&heap_lock);
+    void *ptr = first_free(len);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return ptr;
 }
 
 void kfree(void *ptr) {
+    int flags = spin_lock_irqsave(&heap_lock);
     heap_header_t *head = ptr - sizeof(heap_header_t);
     if((head->is_free == 0) && (head->magic == HEAP_MAGIC)) {
         head->is_free = 1;
@@ -57,6 +63,7 @@ void kfree(void *ptr) {
             app = app->next;
         }
     }
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
 void *first_free(size_t len) {
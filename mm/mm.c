@@ -15,10 +15,13 @@
  */
 
 #include <hal/hal.h>
+#include <hal/smp.h>
+#include <proc/spinlock.h>
 #include <lib/string.h>
 #include <drivers/video.h>
 
 mem_info_t pmm;
+static spinlock_t pmm_lock = SPINLOCK_INIT;
 
 // 32KB for the bitmap to reserve up to 4GB
 static uint32_t bitmap[BITMAP_LEN] __attribute__((aligned(BLOCKS_LEN)));
@@ -120,11 +123,15 @@ void pmm_deinit_reg(mm_addr_t addr, uint32_t size) {
  * Returns a usable block
  */
 void *pmm_malloc() {
+    int flags = spin_lock_irqsave(&pmm_lock);
     int p = pmm_first_free();
-    if(!p)
+    if(p <= 0) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
         return NULL;
+    }
     pmm_set_bit(p);
     pmm.used_blocks++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
     return (void *) (BLOCKS_LEN * p);
 }
 
@@ -134,8 +141,10 @@ void *pmm_malloc() {
 void pmm_free(mm_addr_t *addr) {
     if((uint32_t) addr < KERNEL_SPACE_END)
         return;
+    int flags = spin_lock_irqsave(&pmm_lock);
     pmm_unset_bit((uint32_t) addr / BLOCKS_LEN);
     pmm.used_blocks--;
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 mm_addr_t *get_mem_map() {
@@ -182,10 +191,11 @@ mm_addr_t get_pdbr() {
 }
 
 /**
- * Flushes the TLB cache
+ * Flushes the page from the TLB of every CPU
  */
 void flush_tlb(vmm_addr_t addr) {
-    asm volatile("cli; invlpg (%0); sti" : : "r" (addr));
+    asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+    smp_tlb_shootdown(addr);
 }
 
 /**
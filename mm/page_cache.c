@@ -0,0 +1,151 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <mm/page_cache.h>
+#include <mm/kheap.h>
+#include <proc/spinlock.h>
+
+static cached_page_t *buckets[PAGE_CACHE_BUCKETS];
+static int pages = 0;
+static file_version_t *versions = NULL;
+static spinlock_t cache_lock = SPINLOCK_INIT;
+
+static uint32_t page_cache_hash(uint32_t dev, uint32_t cluster, vmm_addr_t vaddr) {
+    return ((dev * 31 + cluster) * 31 + (vaddr >> 12)) % PAGE_CACHE_BUCKETS;
+}
+
+static cached_page_t *page_cache_find(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr) {
+    cached_page_t *page = buckets[page_cache_hash(dev, cluster, vaddr)];
+    while(page && !((page->dev == dev) && (page->cluster == cluster) && (page->version == version) && (page->vaddr == vaddr)))
+        page = page->next;
+    return page;
+}
+
+static file_version_t *page_cache_find_version(uint32_t dev, uint32_t cluster) {
+    file_version_t *ver = versions;
+    while(ver && !((ver->dev == dev) && (ver->cluster == cluster)))
+        ver = ver->next;
+    return ver;
+}
+
+/**
+ * Current version of the file starting at the cluster, the pages read from it are cached under it
+ */
+uint32_t page_cache_version(uint32_t dev, uint32_t cluster) {
+    int flags = spin_lock_irqsave(&cache_lock);
+    file_version_t *ver = page_cache_find_version(dev, cluster);
+    uint32_t version = ver ? ver->version : 0;
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return version;
+}
+
+/**
+ * Called when the file starting at the cluster is written or deleted, the
+ * pages cached so far are only given to the processes that already use them
+ */
+void page_cache_invalidate(uint32_t dev, uint32_t cluster) {
+    file_version_t *new_ver = (file_version_t *) kmalloc(sizeof(file_version_t));
+    int flags = spin_lock_irqsave(&cache_lock);
+    file_version_t *ver = page_cache_find_version(dev, cluster);
+    if(ver) {
+        ver->version++;
+    } else {
+        new_ver->dev = dev;
+        new_ver->cluster = cluster;
+        new_ver->version = 1;
+        new_ver->next = versions;
+        versions = new_ver;
+        new_ver = NULL;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    if(new_ver)
+        kfree(new_ver);
+}
+
+/**
+ * Returns the frame holding the page and takes a reference on it, 0 if it isn't cached
+ */
+mm_addr_t page_cache_get(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr) {
+    mm_addr_t phys = 0;
+    int flags = spin_lock_irqsave(&cache_lock);
+    cached_page_t *page = page_cache_find(dev, cluster, version, vaddr);
+    if(page) {
+        page->refs++;
+        phys = page->phys;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return phys;
+}
+
+/**
+ * Caches a page that was just loaded, the caller holds the first reference
+ */
+void page_cache_add(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr, mm_addr_t phys) {
+    cached_page_t *page = (cached_page_t *) kmalloc(sizeof(cached_page_t));
+    page->dev = dev;
+    page->cluster = cluster;
+    page->version = version;
+    page->vaddr = vaddr;
+    page->phys = phys;
+    page->refs = 1;
+    
+    int flags = spin_lock_irqsave(&cache_lock);
+    uint32_t hash = page_cache_hash(dev, cluster, vaddr);
+    page->next = buckets[hash];
+    buckets[hash] = page;
+    pages++;
+    spin_unlock_irqrestore(&cache_lock, flags);
+}
+
+/**
+ * Drops a reference on the page, the frame is freed with the last one.
+ * Returns 0 if the frame isn't the cached one, the caller owns it.
+ */
+int page_cache_put(uint32_t dev, uint32_t cluster, uint32_t version, vmm_addr_t vaddr, mm_addr_t phys) {
+    cached_page_t *found = NULL;
+    int last = 0;
+    int flags = spin_lock_irqsave(&cache_lock);
+    cached_page_t **link = &buckets[page_cache_hash(dev, cluster, vaddr)];
+    while(*link) {
+        cached_page_t *page = *link;
+        if((page->dev == dev) && (page->cluster == cluster) && (page->version == version) && (page->vaddr == vaddr) && (page->phys == phys)) {
+            found = page;
+            if(--page->refs == 0) {
+                *link = page->next;
+                pages--;
+                last = 1;
+            }
+            break;
+        }
+        link = &page->next;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    
+    if(!found)
+        return 0;
+    if(last) {
+        pmm_free((mm_addr_t *) found->phys);
+        kfree(found);
+    }
+    return 1;
+}
+
+/**
+ * Number of frames shared through the cache
+ */
+int page_cache_pages() {
+    return pages;
+}
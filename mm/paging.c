@@ -16,6 +16,7 @@
 
 #include <lib/string.h>
 #include <mm/memory.h>
+#include <proc/spinlock.h>
 
 #define MAX_BLOCKS 512
 #define PAGE_START 0x200000
@@ -23,16 +24,21 @@
 // 16B to hold up 2 MB of paging structures
 static uint32_t bitmap[0x10];
 static int used_blocks = 0;
+static spinlock_t paging_lock = SPINLOCK_INIT;
 
 /**
  * Allocates space for a page table
  */
 void *page_table_malloc() {
+    int flags = spin_lock_irqsave(&paging_lock);
     int p = paging_first_free();
-    if(p == -1)
+    if(p == -1) {
+        spin_unlock_irqrestore(&paging_lock, flags);
         return NULL;
+    }
     paging_set_bit(p);
     used_blocks++;
+    spin_unlock_irqrestore(&paging_lock, flags);
     void *addr = (void *) ((BLOCKS_LEN * p) + PAGE_START);
     memset(addr, 0, PAGE_SIZE);
     return addr;
@@ -75,8 +81,10 @@ int paging_first_free() {
  * Frees a block
  */
 void page_table_free(void *addr) {
+    int flags = spin_lock_irqsave(&paging_lock);
     paging_unset_bit(((uint32_t) addr / BLOCKS_LEN) - PAGE_START);
     used_blocks--;
+    spin_unlock_irqrestore(&paging_lock, flags);
 }
 
 uint32_t *get_page_table_bitmap() {
@@ -26,18 +26,15 @@
  * | kernel_end - 0x200000 -> kernel heap           |
  * | 0x200000 - 0x400000 -> paging structures       |
  * |------------------------------------------------|
- * | 0x400000 - 0x401000 -> common space            |
+ * | 0x400000 - 0x401000 -> common space, user r/o  |
  * |------------------------------------------------|
- * | 0x401000 - 0x700000 -> free space              |
- * |------------------------------------------------|
- * | 0x700000 - 0x800000 -> elf loading space       |
+ * | 0x401000 - 0x800000 -> free space              |
  * |------------------------------------------------|
  * | 0x800000 - end -> programs address space       |
  * |------------------------------------------------|
  */
 
 page_dir_t kern_dir[1024] __attribute__((aligned(4096)));
-page_dir_t *current_dir = 0;
 
 extern uint32_t kernel_start;
 extern uint32_t kernel_end;
@@ -70,25 +67,27 @@ void map_kernel(page_dir_t *pdir) {
         }
         ((uint32_t *) (pdir[virt >> 22] & ~0xFFF))[virt << 10 >> 10 >> 12] = phys | PAGE_PRESENT | PAGE_RW;
     }
-    // Space for RETURN_ADDR
+    // Space for RETURN_ADDR, the programs can only read it
     uint32_t ret_addr = (uint32_t) RETURN_ADDR;
     if(!vmm_create_page_table(pdir, ret_addr, PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
         printk("Error creating page table");
         return;
     }
-    ((uint32_t *) (pdir[ret_addr >> 22] & ~0xFFF))[ret_addr << 10 >> 10 >> 12] = ret_addr | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+    ((uint32_t *) (pdir[ret_addr >> 22] & ~0xFFF))[ret_addr << 10 >> 10 >> 12] = ret_addr | PAGE_PRESENT | PAGE_USER;
 }
 
 /**
  * Switches page directory with the given one
  */
 void change_page_directory(page_dir_t *p) {
-    current_dir = p;
-    load_pdbr((mm_addr_t) current_dir);
+    load_pdbr((mm_addr_t) p);
 }
 
+/**
+ * Page directory of the calling CPU
+ */
 page_dir_t *get_page_directory() {
-    return current_dir;
+    return (page_dir_t *) get_pdbr();
 }
 
 page_dir_t *get_kern_directory() {
@@ -156,6 +155,26 @@ void *get_phys_addr(page_dir_t *pdir, vmm_addr_t virt) {
     return (void *) (((uint32_t *) (pdir[virt >> 22] & ~0xFFF))[virt << 10 >> 10 >> 12] >> 12 << 12);
 }
 
+/**
+ * Checks that the user can read every byte from virt to virt + len
+ */
+int vmm_user_mapped(page_dir_t *pdir, vmm_addr_t virt, uint32_t len) {
+    if((len == 0) || (virt + len < virt))
+        return 0;
+    for(vmm_addr_t page = virt & ~(PAGE_SIZE - 1); page < virt + len; page += PAGE_SIZE) {
+        uint32_t pde = pdir[page >> 22];
+        if(!(pde & PAGE_PRESENT) || !(pde & PAGE_USER))
+            return 0;
+        uint32_t pte = ((uint32_t *) (pde & ~0xFFF))[page << 10 >> 10 >> 12];
+        if(!(pte & PAGE_PRESENT) || !(pte & PAGE_USER))
+            return 0;
+        // The last page of the address space
+        if(page + PAGE_SIZE < page)
+            break;
+    }
+    return 1;
+}
+
 /**
  * Creates a page directory to be used with a process
  */
@@ -206,8 +225,10 @@ void vmm_unmap(page_dir_t *pdir, vmm_addr_t virt) {
     if(pdir[virt >> 22] != NULL) {
         void *addr = get_phys_addr(pdir, virt);
         if(addr) {
-            pmm_free(addr);
+            // No CPU may still reach the block once it's free
             ((uint32_t *) (pdir[virt >> 22] & ~0xFFF))[virt << 10 >> 10 >> 12] = 0;
+            flush_tlb(virt);
+            pmm_free(addr);
         } else {
             printk("Error unmapping memory\n");
         }
@@ -220,6 +241,7 @@ void vmm_unmap(page_dir_t *pdir, vmm_addr_t virt) {
 void vmm_unmap_phys(page_dir_t *pdir, vmm_addr_t virt) {
     if(pdir[virt >> 22] != NULL) {
         ((uint32_t *) (pdir[virt >> 22] & ~0xFFF))[virt << 10 >> 10 >> 12] = 0;
+        flush_tlb(virt);
     }
 }
 
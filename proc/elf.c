@@ -21,8 +21,13 @@
 #include <lib/string.h>
 #include <elf.h>
 #include <drivers/video.h>
+#include <drivers/io.h>
+#include <proc/sched.h>
+#include <proc/preempt.h>
+#include <mm/page_cache.h>
 
-#define MEMORY_LOAD_ADDRESS 0x700000
+// The first process to touch a shared page loads it, the others wait
+static mutex_t share_lock = MUTEX_INIT;
 
 /**
  * Checks if the file can be executed in this OS
@@ -59,111 +64,673 @@ int elf_validate(elf_header_t *eh) {
 }
 
 /**
- * Loads an ELF executable in memory and partially builds threads' info
+ * Reads the first sector of the file, where the headers have to be
  */
-int load_elf(char *name, thread_t *thread, page_dir_t *pdir) {
-    // Load the file into memory
-    uint32_t file_size = load_elf_file(name);
-    if(!file_size) {
-        console_print("Error loading file\n");
+static int elf_read_headers(char *name, elf_image_t *image, char *buf) {
+    file *f = vfs_file_open(name, "r");
+    if((f->type == FS_NULL) || (f->type == FS_DIR)) {
+        console_print("Failed opening %s\n", name);
+        kfree(f);
         return 0;
     }
+    image->f = *f;
+    image->version = page_cache_version(f->dev, f->current_cluster);
+    vfs_file_read(f, buf);
+    vfs_file_close(f);
     
-    // Check the elf header
-    elf_header_t *eh = (elf_header_t *) MEMORY_LOAD_ADDRESS;
+    elf_header_t *eh = (elf_header_t *) buf;
     if(!elf_validate(eh)) {
         console_print("Failed validating elf\n");
         return 0;
     }
-    
-    // Relocate executable parts
-    if(!load_elf_relocate(thread, pdir, eh)) {
-        console_print("Error relocating\n");
+    if(eh->program_header + (eh->entry_number_prog_header * sizeof(program_header_t)) > VFS_BLOCK_SIZE) {
+        console_print("Program headers past the first sector\n");
         return 0;
     }
+    return 1;
+}
+
+/**
+ * Copies len bytes of the executable from the given offset
+ */
+static void elf_read(elf_image_t *image, uint32_t offset, char *dst, uint32_t len, char *buf) {
+    file f = image->f;
+    vfs_file_seek(&f, offset / VFS_BLOCK_SIZE);
+    uint32_t skip = offset % VFS_BLOCK_SIZE;
+    while(len && !f.eof) {
+        vfs_file_read(&f, buf);
+        uint32_t n = VFS_BLOCK_SIZE - skip;
+        if(n > len)
+            n = len;
+        memcpy(dst, buf + skip, n);
+        dst += n;
+        len -= n;
+        skip = 0;
+    }
+}
+
+/**
+ * Copies the part of [vaddr, vaddr + len) that the segments take from the file,
+ * the rest of dst is left as it is
+ */
+static void elf_read_vaddr(elf_image_t *image, vmm_addr_t vaddr, char *dst, uint32_t len, char *buf) {
+    for(int i = 0; i < image->segments; i++) {
+        elf_segment_t *seg = &image->segment[i];
+        uint32_t from = (seg->vaddr > vaddr) ? seg->vaddr : vaddr;
+        uint32_t to = seg->vaddr + seg->file_size;
+        if(to > vaddr + len)
+            to = vaddr + len;
+        if(from < to)
+            elf_read(image, seg->offset + (from - seg->vaddr), dst + (from - vaddr), to - from, buf);
+    }
+}
+
+/**
+ * Records the loadable segments, moved by the base of the image. Nothing is mapped yet.
+ */
+static int elf_load_segments(elf_image_t *image, elf_header_t *eh) {
+    program_header_t *ph = (program_header_t *) ((uint32_t) eh + eh->program_header);
     
-    // Unmap executable from kernel directory
-    for(uint32_t i = 0; i < file_size; i++) {
-        vmm_unmap(get_kern_directory(), (uint32_t) MEMORY_LOAD_ADDRESS + (i * PAGE_SIZE));
+    uint32_t start = 0xFFFFFFFF, end = 0;
+    image->segments = 0;
+    for(uint32_t i = 0; i < eh->entry_number_prog_header; i++) {
+        // Only the loadable parts take memory
+        if((ph[i].p_type != ELF_PT_LOAD) || (ph[i].p_mem_size == 0))
+            continue;
+        
+        if(image->segments == EXE_MAX_SEGMENTS) {
+            console_print("Too many segments\n");
+            return 0;
+        }
+        elf_segment_t *seg = &image->segment[image->segments++];
+        seg->vaddr = image->base + ph[i].p_vaddr;
+        seg->mem_size = ph[i].p_mem_size;
+        seg->offset = ph[i].p_offset;
+        seg->file_size = ph[i].p_file_size;
+        seg->flags = ph[i].p_flags;
+        
+        if(seg->vaddr < start)
+            start = seg->vaddr;
+        if(seg->vaddr + seg->mem_size > end)
+            end = seg->vaddr + seg->mem_size;
     }
+    if(image->segments == 0)
+        return 0;
     
+    // The image spans whole pages, from the lowest segment to the end of the highest one
+    image->start = start & ~(PAGE_SIZE - 1);
+    image->end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     return 1;
 }
 
 /**
- * Moves the file from the disk to RAM
+ * Copies a table of the dynamic section into the kernel heap
  */
-int load_elf_file(char *name) {
-    // Open the executable
-    file *f = vfs_file_open(name, "r");
-    if((f->type == FS_NULL) || (f->type == FS_DIR)) {
-        console_print("Failed opening file\n");
+static void *elf_copy_table(elf_image_t *image, uint32_t addr, uint32_t size, char *buf) {
+    if(!addr || !size)
+        return NULL;
+    void *table = kmalloc(size);
+    memset(table, 0, size);
+    elf_read_vaddr(image, image->base + addr, (char *) table, size, buf);
+    return table;
+}
+
+/**
+ * Copies the hash, symbol and string tables
+ */
+static int elf_load_symbols(elf_image_t *image, uint32_t hash, uint32_t strtab, uint32_t strsz, uint32_t symtab, char *buf) {
+    // The hash table starts with the number of buckets and of symbols
+    uint32_t counts[2] = { 0, 0 };
+    elf_read_vaddr(image, image->base + hash, (char *) counts, sizeof(counts), buf);
+    image->hash = (uint32_t *) elf_copy_table(image, hash, (2 + counts[0] + counts[1]) * sizeof(uint32_t), buf);
+    image->symtab = (elf_symbol_t *) elf_copy_table(image, symtab, counts[1] * sizeof(elf_symbol_t), buf);
+    image->strtab = (char *) elf_copy_table(image, strtab, strsz + 1, buf);
+    if(counts[0] == 0) {
+        console_print("Empty symbol hash table\n");
         return 0;
     }
+    return 1;
+}
+
+/**
+ * Copies the symbol, string, hash and relocation tables the dynamic section points to.
+ * Returns how many libraries are needed, their names are put in needed, -1 on error.
+ */
+static int elf_load_dynamic(elf_image_t *image, elf_header_t *eh, uint32_t *needed) {
+    program_header_t *ph = (program_header_t *) ((uint32_t) eh + eh->program_header);
+    program_header_t *dyn_ph = NULL;
+    for(uint32_t i = 0; i < eh->entry_number_prog_header; i++) {
+        if(ph[i].p_type == ELF_PT_DYNAMIC)
+            dyn_ph = &ph[i];
+    }
+    // Statically linked
+    if(!dyn_ph)
+        return 0;
+    
+    // The headers are still needed, the file is read through another buffer
+    char *buf = (char *) kmalloc(VFS_BLOCK_SIZE);
+    elf_dynamic_t *dyn = (elf_dynamic_t *) kmalloc(dyn_ph->p_file_size);
+    elf_read(image, dyn_ph->p_offset, (char *) dyn, dyn_ph->p_file_size, buf);
     
-    // Load the executable in memory
-    uint32_t j = 0;
-    int file_size = 0;
-    while(f->eof != 1) {
-        // The executable needs more memory, so reserve it
-        if(((j + 8) % 8) == 0) {
-            if(!vmm_map(get_kern_directory(), (uint32_t) MEMORY_LOAD_ADDRESS + (j * 512), PAGE_PRESENT | PAGE_RW)) {
-                console_print("Error mapping memory");
+    uint32_t hash = 0, strtab = 0, strsz = 0, symtab = 0, rel = 0, relsz = 0, jmprel = 0, pltrelsz = 0;
+    int libs = 0, textrel = 0;
+    for(uint32_t i = 0; (i < dyn_ph->p_file_size / sizeof(elf_dynamic_t)) && (dyn[i].tag != DT_NULL); i++) {
+        switch(dyn[i].tag) {
+            case DT_NEEDED:
+                if(libs == ELF_MAX_LIBS) {
+                    console_print("Too many libraries\n");
+                    kfree(dyn);
+                    kfree(buf);
+                    return -1;
+                }
+                needed[libs++] = dyn[i].val;
+                break;
+            case DT_HASH:       hash = dyn[i].val; break;
+            case DT_STRTAB:     strtab = dyn[i].val; break;
+            case DT_STRSZ:      strsz = dyn[i].val; break;
+            case DT_SYMTAB:     symtab = dyn[i].val; break;
+            case DT_REL:        rel = dyn[i].val; break;
+            case DT_RELSZ:      relsz = dyn[i].val; break;
+            case DT_JMPREL:     jmprel = dyn[i].val; break;
+            case DT_PLTRELSZ:   pltrelsz = dyn[i].val; break;
+            case DT_SYMBOLIC:   image->symbolic = 1; break;
+            case DT_TEXTREL:    textrel = 1; break;
+            case DT_FLAGS:
+                if(dyn[i].val & DF_SYMBOLIC)
+                    image->symbolic = 1;
+                if(dyn[i].val & DF_TEXTREL)
+                    textrel = 1;
+                break;
+            case DT_RELA:
+                console_print("RELA relocations aren't supported\n");
+                kfree(dyn);
+                kfree(buf);
                 return -1;
-            }
-            file_size++;
         }
-        // Copy the file into memory
-        vfs_file_read(f, (char *) MEMORY_LOAD_ADDRESS + (j * 512));
-        j++;
     }
-    vfs_file_close(f);
-    return file_size;
+    kfree(dyn);
+    
+    int ret = libs;
+    // The text of the executable is shared, so it can only be moved by its own base
+    if(textrel && !image->symbolic) {
+        console_print("Text relocations need a symbolic object\n");
+        ret = -1;
+    } else if(!hash || !strtab || !symtab) {
+        console_print("Dynamic section without symbols\n");
+        ret = -1;
+    } else {
+        ret = elf_load_symbols(image, hash, strtab, strsz, symtab, buf) ? libs : -1;
+        image->rel = (elf_rel_t *) elf_copy_table(image, rel, relsz, buf);
+        image->rels = relsz / sizeof(elf_rel_t);
+        image->jmprel = (elf_rel_t *) elf_copy_table(image, jmprel, pltrelsz, buf);
+        image->jmprels = pltrelsz / sizeof(elf_rel_t);
+    }
+    kfree(buf);
+    return ret;
+}
+
+static void elf_free_tables(elf_image_t *image) {
+    void *tables[] = { image->hash, image->symtab, image->strtab, image->rel, image->jmprel };
+    for(uint32_t i = 0; i < sizeof(tables) / sizeof(void *); i++) {
+        if(tables[i])
+            kfree(tables[i]);
+    }
 }
 
 /**
- * Moves the executable parts to the correct virtual address for execution
+ * Hash function of the ELF symbol table
  */
-int load_elf_relocate(thread_t *thread, page_dir_t *pdir, elf_header_t *eh) {
-    // Get the program header
-    program_header_t *ph = (program_header_t *) ((uint32_t) eh + eh->program_header);
-    // Get the entry point of the program
-    thread->eip = eh->entry;
-    // Get the base image virtual address
-    thread->image_base = ph[0].p_vaddr;
-    
-    // Relocate the executable program parts into the correct memory locations
-    uint32_t i, last;
-    for(i = 0; i < eh->entry_number_prog_header; i++) {
-        // If the part is executable
-        if(ph[i].p_type == 1) {
-            if(ph[i].p_mem_size == 0)
+static uint32_t elf_hash(const char *name) {
+    uint32_t h = 0, g;
+    while(*name) {
+        h = (h << 4) + (uint8_t) *name++;
+        g = h & 0xF0000000;
+        if(g)
+            h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+/**
+ * Looks for a symbol defined by the image
+ */
+static elf_symbol_t *elf_lookup(elf_image_t *image, char *name) {
+    if(!image->hash)
+        return NULL;
+    uint32_t nbucket = image->hash[0];
+    uint32_t *chain = &image->hash[2 + nbucket];
+    for(uint32_t i = image->hash[2 + (elf_hash(name) % nbucket)]; i != 0; i = chain[i]) {
+        elf_symbol_t *sym = &image->symtab[i];
+        if((sym->st_shndx != SHN_UNDEF) && (strcmp(image->strtab + sym->st_name, name) == 0))
+            return sym;
+    }
+    return NULL;
+}
+
+/**
+ * Finds the definition of a symbol used by obj. The executable comes first, then
+ * its libraries in order, a symbolic object looks in itself before anything else.
+ * Copy relocations skip the executable, which holds the copy.
+ */
+static int elf_resolve(elf_image_t *exe, elf_image_t *obj, uint32_t index, int copy, uint32_t *value, elf_image_t **def, uint32_t *size) {
+    elf_symbol_t *sym = &obj->symtab[index];
+    char *name = obj->strtab + sym->st_name;
+    
+    elf_image_t *scope[ELF_MAX_LIBS + 2];
+    int n = 0;
+    if(obj->symbolic)
+        scope[n++] = obj;
+    if(!copy)
+        scope[n++] = exe;
+    for(int i = 0; i < exe->libs; i++)
+        scope[n++] = exe->lib[i];
+    
+    for(int i = 0; i < n; i++) {
+        elf_symbol_t *found = elf_lookup(scope[i], name);
+        if(found) {
+            *value = scope[i]->base + found->st_value;
+            *def = scope[i];
+            *size = found->st_size;
+            return 1;
+        }
+    }
+    // Undefined weak symbols are 0
+    *value = 0;
+    *def = NULL;
+    *size = 0;
+    return (sym->st_info >> 4) == STB_WEAK;
+}
+
+static int elf_writable(elf_image_t *image, vmm_addr_t vaddr) {
+    for(int i = 0; i < image->segments; i++) {
+        elf_segment_t *seg = &image->segment[i];
+        if((vaddr >= seg->vaddr) && (vaddr < seg->vaddr + seg->mem_size) && (seg->flags & ELF_WRITABLE))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks before the process starts that the relocations of obj can all be applied
+ */
+static int elf_check_relocs(elf_image_t *exe, elf_image_t *obj, elf_rel_t *rel, uint32_t n) {
+    for(uint32_t i = 0; i < n; i++) {
+        uint32_t type = ELF_REL_TYPE(rel[i].r_info);
+        uint32_t index = ELF_REL_SYM(rel[i].r_info);
+        if((type != R_386_32) && (type != R_386_PC32) && (type != R_386_COPY) &&
+           (type != R_386_GLOB_DAT) && (type != R_386_JMP_SLOT) && (type != R_386_RELATIVE)) {
+            console_print("Unsupported relocation %d\n", type);
+            return 0;
+        }
+        if(!index || (type == R_386_RELATIVE))
+            continue;
+        
+        uint32_t value, size;
+        elf_image_t *def;
+        if(!elf_resolve(exe, obj, index, type == R_386_COPY, &value, &def, &size)) {
+            console_print("Undefined symbol %s\n", obj->strtab + obj->symtab[index].st_name);
+            return 0;
+        }
+        // A symbolic library was bound to its own variable when it was linked, it would never see the copy
+        if((type == R_386_COPY) && def && def->symbolic) {
+            console_print("Copy relocation against symbolic %s\n", obj->strtab + obj->symtab[index].st_name);
+            return 0;
+        }
+        // A shared page has to be the same in every process
+        if(!elf_writable(obj, obj->base + rel[i].r_offset) && (def != obj)) {
+            console_print("Text relocation against %s\n", obj->strtab + obj->symtab[index].st_name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Applies the relocations of obj that touch the page, the page holds what the file has
+ */
+static void elf_relocate_page(elf_image_t *exe, elf_image_t *obj, elf_rel_t *rel, uint32_t n, vmm_addr_t page, char *buf) {
+    for(uint32_t i = 0; i < n; i++) {
+        uint32_t type = ELF_REL_TYPE(rel[i].r_info);
+        uint32_t index = ELF_REL_SYM(rel[i].r_info);
+        vmm_addr_t where = obj->base + rel[i].r_offset;
+        
+        uint32_t sym = 0, size = 0;
+        elf_image_t *def = NULL;
+        if(type == R_386_COPY) {
+            // The executable gets its own copy of a variable of a library
+            elf_resolve(exe, obj, index, 1, &sym, &def, &size);
+            uint32_t from = (where > page) ? where : page;
+            uint32_t to = where + size;
+            if(to > page + PAGE_SIZE)
+                to = page + PAGE_SIZE;
+            if(def && (from < to))
+                elf_read_vaddr(def, sym + (from - where), (char *) from, to - from, buf);
+            continue;
+        }
+        if((where + sizeof(uint32_t) <= page) || (where >= page + PAGE_SIZE))
+            continue;
+        
+        // The addend is in the file, it may be split with the next page
+        uint32_t addend = 0;
+        if((where >= page) && (where + sizeof(uint32_t) <= page + PAGE_SIZE))
+            addend = *(uint32_t *) where;
+        else
+            elf_read_vaddr(obj, where, (char *) &addend, sizeof(uint32_t), buf);
+        if(index && (type != R_386_RELATIVE))
+            elf_resolve(exe, obj, index, 0, &sym, &def, &size);
+        
+        uint32_t value;
+        switch(type) {
+            case R_386_32:
+                value = sym + addend;
+                break;
+            case R_386_PC32:
+                value = sym + addend - where;
+                break;
+            case R_386_GLOB_DAT:
+            case R_386_JMP_SLOT:
+                value = sym;
+                break;
+            case R_386_RELATIVE:
+                value = obj->base + addend;
+                break;
+            default:
                 continue;
-            
-            // Allocate pages for the program executable
-            for(uint32_t j = 0; j <= ph[i].p_file_size / PAGE_SIZE; j++) {
-                // Map executable in kernel and proc page directory
-                if(!vmm_map(get_kern_directory(), ph[i].p_vaddr + (j * PAGE_SIZE), PAGE_PRESENT | PAGE_RW) ||
-                   !vmm_map_phys(pdir, ph[i].p_vaddr + (j * PAGE_SIZE), (uint32_t) get_phys_addr(get_kern_directory(), ph[i].p_vaddr), PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
-                    console_print("Error mapping memory");
-                    return 0;
-                }
+        }
+        for(uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            if((where + b >= page) && (where + b < page + PAGE_SIZE))
+                ((uint8_t *) where)[b] = ((uint8_t *) &value)[b];
+        }
+    }
+}
+
+// Libraries stay loaded until their file changes, each one at its own base
+static elf_image_t *lib_list = NULL;
+static uint32_t lib_slots = 0;      // one bit each
+static mutex_t lib_lock = MUTEX_INIT;
+
+static void elf_unload_lib(elf_image_t *lib);
+
+/**
+ * Frees the libraries nobody uses whose file changed, lib_lock must be held
+ */
+static void elf_free_libs() {
+    elf_image_t **link = &lib_list;
+    while(*link) {
+        elf_image_t *lib = *link;
+        if(!lib->refs && (lib->version != page_cache_version(lib->f.dev, lib->f.current_cluster))) {
+            *link = lib->next;
+            lib_slots &= ~(1 << lib->slot);
+            elf_free_tables(lib);
+            kfree(lib);
+        } else {
+            link = &lib->next;
+        }
+    }
+}
+
+/**
+ * Returns the shared library at path, loading its headers the first time
+ */
+static elf_image_t *elf_load_lib(char *path) {
+    char *buf = (char *) kmalloc(VFS_BLOCK_SIZE);
+    elf_image_t *image = (elf_image_t *) kmalloc(sizeof(elf_image_t));
+    memset(image, 0, sizeof(elf_image_t));
+    
+    mutex_lock(&lib_lock);
+    elf_free_libs();
+    if(!elf_read_headers(path, image, buf)) {
+        kfree(image);
+        image = NULL;
+    } else {
+        // The file is the same if it starts at the same cluster of the same device and wasn't changed
+        elf_image_t *lib = lib_list;
+        while(lib && !((lib->f.dev == image->f.dev) && (lib->f.current_cluster == image->f.current_cluster) &&
+                       (lib->version == image->version)))
+            lib = lib->next;
+        
+        elf_header_t *eh = (elf_header_t *) buf;
+        uint32_t needed[ELF_MAX_LIBS];
+        int slot = 0;
+        while((slot < ELF_LIB_SLOTS) && (lib_slots & (1 << slot)))
+            slot++;
+        if(lib) {
+            kfree(image);
+            image = lib;
+            image->refs++;
+        } else if(eh->type != ELF_ET_DYN) {
+            console_print("%s is not a shared library\n", path);
+            kfree(image);
+            image = NULL;
+        } else {
+            image->slot = slot;
+            image->base = ELF_LIB_BASE + (slot * ELF_LIB_SPAN);
+            if((slot == ELF_LIB_SLOTS) || !elf_load_segments(image, eh) || (image->end - image->base > ELF_LIB_SPAN) ||
+               (elf_load_dynamic(image, eh, needed) < 0)) {
+                console_print("Failed loading %s\n", path);
+                elf_free_tables(image);
+                kfree(image);
+                image = NULL;
+            } else {
+                lib_slots |= 1 << slot;
+                image->refs = 1;
+                image->next = lib_list;
+                lib_list = image;
             }
-            // Copy the executable into the correct memory location
-            memcpy((uint32_t *) ph[i].p_vaddr, (uint32_t *) ((uint32_t) MEMORY_LOAD_ADDRESS + ph[i].p_offset), ph[i].p_file_size);
-            memset((void *) ph[i].p_vaddr + ph[i].p_file_size, 0, ph[i].p_mem_size - ph[i].p_file_size);
-            // Unmap from kernel directory
-            for(uint32_t j = 0; j <= ph[i].p_file_size / PAGE_SIZE; j++) {
-                vmm_unmap_phys(get_kern_directory(), ph[i].p_vaddr + (j * PAGE_SIZE));
+        }
+    }
+    mutex_unlock(&lib_lock);
+    kfree(buf);
+    return image;
+}
+
+/**
+ * Loads the libraries the executable needs from its own directory and checks
+ * that every relocation can be applied
+ */
+static int elf_link(char *name, elf_image_t *image, uint32_t *needed, int libs) {
+    // Length of the directory part of the name
+    uint32_t len = 0;
+    for(uint32_t i = 0; name[i]; i++) {
+        if(name[i] == '/')
+            len = i + 1;
+    }
+    
+    char *path = (char *) kmalloc(64);
+    int ret = 1;
+    for(int i = 0; ret && (i < libs); i++) {
+        char *lib_name = image->strtab + needed[i];
+        if(len + strlen(lib_name) >= 64) {
+            ret = 0;
+            break;
+        }
+        memcpy(path, name, len);
+        strcpy(path + len, lib_name);
+        image->lib[i] = elf_load_lib(path);
+        if(!image->lib[i])
+            ret = 0;
+        else
+            image->libs++;
+    }
+    kfree(path);
+    
+    if(ret)
+        ret = elf_check_relocs(image, image, image->rel, image->rels) && elf_check_relocs(image, image, image->jmprel, image->jmprels);
+    for(int i = 0; ret && (i < image->libs); i++) {
+        elf_image_t *lib = image->lib[i];
+        ret = elf_check_relocs(image, lib, lib->rel, lib->rels) && elf_check_relocs(image, lib, lib->jmprel, lib->jmprels);
+    }
+    return ret;
+}
+
+/**
+ * Loads the headers of the executable, its segments are read from the file
+ * by the page fault handler the first time the process touches them.
+ * The libraries it needs are linked when their pages are loaded.
+ */
+int load_elf(char *name, process_t *proc) {
+    thread_t *thread = proc->thread_list;
+    char *buf = (char *) kmalloc(VFS_BLOCK_SIZE);
+    elf_image_t *image = (elf_image_t *) kmalloc(sizeof(elf_image_t));
+    memset(image, 0, sizeof(elf_image_t));
+    
+    int ret = 0;
+    uint32_t needed[ELF_MAX_LIBS];
+    int libs = 0;
+    elf_header_t *eh = (elf_header_t *) buf;
+    if(!elf_read_headers(name, image, buf)) {
+        console_print("Error loading file\n");
+    } else if(eh->type != ELF_ET_EXEC) {
+        console_print("Not an executable\n");
+    } else if(!elf_load_segments(image, eh)) {
+        console_print("Error loading segments\n");
+    } else if((libs = elf_load_dynamic(image, eh, needed)) < 0) {
+        console_print("Error loading the dynamic section\n");
+    } else if(!elf_link(name, image, needed, libs)) {
+        console_print("Error linking\n");
+    } else {
+        thread->eip = eh->entry;
+        thread->image_base = image->start;
+        thread->image_size = image->end - image->start;
+        proc->image = image;
+        ret = 1;
+    }
+    
+    if(!ret) {
+        for(int i = 0; i < image->libs; i++)
+            elf_unload_lib(image->lib[i]);
+        elf_free_tables(image);
+        kfree(image);
+    }
+    kfree(buf);
+    return ret;
+}
+
+/**
+ * Fills a mapped page of an object, the file part of the segments is read,
+ * the rest of the page (.bss) stays zero and the relocations are applied
+ */
+static void elf_fill_page(elf_image_t *exe, elf_image_t *obj, vmm_addr_t page) {
+    memset((void *) page, 0, PAGE_SIZE);
+    char *buf = (char *) kmalloc(VFS_BLOCK_SIZE);
+    elf_read_vaddr(obj, page, (char *) page, PAGE_SIZE, buf);
+    elf_relocate_page(exe, obj, obj->rel, obj->rels, page, buf);
+    elf_relocate_page(exe, obj, obj->jmprel, obj->jmprels, page, buf);
+    kfree(buf);
+}
+
+/**
+ * Maps a read-only page of an object, every process running the same file
+ * gets the same frame. The first one loads it into the page cache.
+ */
+static int elf_share_page(process_t *proc, elf_image_t *obj, vmm_addr_t page) {
+    int ret = 1;
+    mutex_lock(&share_lock);
+    mm_addr_t phys = page_cache_get(obj->f.dev, obj->f.current_cluster, obj->version, page);
+    if(phys) {
+        ret = vmm_map_phys(proc->pdir, page, phys, PAGE_PRESENT | PAGE_USER);
+        if(!ret)
+            page_cache_put(obj->f.dev, obj->f.current_cluster, obj->version, page, phys);
+    } else if(vmm_map(proc->pdir, page, PAGE_PRESENT | PAGE_USER)) {
+        // The kernel can still write the page, CR0.WP isn't set
+        elf_fill_page(proc->image, obj, page);
+        page_cache_add(obj->f.dev, obj->f.current_cluster, obj->version, page, (mm_addr_t) get_phys_addr(proc->pdir, page));
+    } else {
+        ret = 0;
+    }
+    mutex_unlock(&share_lock);
+    return ret;
+}
+
+/**
+ * Loads the page of the executable or of one of its libraries containing addr,
+ * if there is one. Pages with writable data are private to the process, the others are shared.
+ */
+int elf_fault(vmm_addr_t addr) {
+    thread_t *thread = get_cur_thread();
+    if(!thread)
+        return 0;
+    process_t *proc = (process_t *) thread->parent;
+    elf_image_t *image = proc->image;
+    // Reading the file sleeps
+    if(!image || (get_page_directory() != proc->pdir) || preempt_count())
+        return 0;
+    
+    vmm_addr_t page = addr & ~(PAGE_SIZE - 1);
+    elf_image_t *obj = NULL;
+    uint32_t flags = 0;
+    for(int n = -1; !obj && (n < image->libs); n++) {
+        elf_image_t *cur = (n < 0) ? image : image->lib[n];
+        for(int i = 0; i < cur->segments; i++) {
+            elf_segment_t *seg = &cur->segment[i];
+            if((seg->vaddr < page + PAGE_SIZE) && (seg->vaddr + seg->mem_size > page)) {
+                flags |= seg->flags;
+                obj = cur;
             }
-            last = i;
         }
     }
-    // The size of the executable in memory is equal to the virtual address of the last section + the offset - the start
-    thread->image_size = ph[last].p_vaddr + ph[last].p_mem_size - thread->eip;
-    // Round up the image size
-    while((thread->image_size % PAGE_SIZE) != 0) {
-        thread->image_size++;
+    if(!obj)
+        return 0;
+    
+    enable_int();
+    mutex_lock(&proc->image_lock);
+    // Another thread may have loaded it in the meantime
+    int ret = 1;
+    if(!get_phys_addr(proc->pdir, page)) {
+        if(!proc->pdir[page >> 22] && !vmm_create_page_table(proc->pdir, page, PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
+            ret = 0;
+        } else if(!(flags & ELF_WRITABLE)) {
+            ret = elf_share_page(proc, obj, page);
+        } else if(!vmm_map(proc->pdir, page, PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
+            ret = 0;
+        } else {
+            elf_fill_page(image, obj, page);
+        }
     }
-    return 1;
+    mutex_unlock(&proc->image_lock);
+    return ret;
+}
+
+/**
+ * Unmaps the pages of an object that were loaded, the shared ones go back to the page cache
+ */
+static void elf_unload_object(process_t *proc, elf_image_t *obj) {
+    for(vmm_addr_t addr = obj->start; addr < obj->end; addr += PAGE_SIZE) {
+        mm_addr_t phys = (mm_addr_t) get_phys_addr(proc->pdir, addr);
+        if(!phys)
+            continue;
+        if(page_cache_put(obj->f.dev, obj->f.current_cluster, obj->version, addr, phys))
+            vmm_unmap_phys(proc->pdir, addr);
+        else
+            vmm_unmap(proc->pdir, addr);
+    }
+}
+
+/**
+ * Drops a reference on a library, it stays loaded for the next processes
+ * unless its file changed since
+ */
+static void elf_unload_lib(elf_image_t *lib) {
+    mutex_lock(&lib_lock);
+    lib->refs--;
+    elf_free_libs();
+    mutex_unlock(&lib_lock);
+}
+
+/**
+ * Unmaps the executable and its libraries
+ */
+void elf_unload(process_t *proc) {
+    elf_image_t *image = proc->image;
+    if(!image)
+        return;
+    elf_unload_object(proc, image);
+    for(int i = 0; i < image->libs; i++) {
+        elf_unload_object(proc, image->lib[i]);
+        elf_unload_lib(image->lib[i]);
+    }
+    elf_free_tables(image);
+    kfree(image);
+    proc->image = NULL;
 }
@@ -0,0 +1,458 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/fair.h>
+#include <lib/math.h>
+
+/*
+ * Every nice level is about 10% more or less CPU than the next one:
+ * weight = 1024 / 1.25^nice
+ */
+static const uint32_t nice_to_weight[40] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15,
+};
+
+/*
+ * 2^32 / nice_to_weight, so scaling the runtime is a multiplication
+ */
+static const uint32_t nice_to_wmult[40] = {
+    /* -20 */ 48388, 59856, 76040, 92818, 118348,
+    /* -15 */ 147320, 184698, 229616, 287308, 360437,
+    /* -10 */ 449829, 563644, 704093, 875809, 1099582,
+    /*  -5 */ 1376151, 1717300, 2157191, 2708050, 3363326,
+    /*   0 */ 4194304, 5237765, 6557202, 8165337, 10153587,
+    /*   5 */ 12820798, 15790321, 19976592, 24970740, 31350126,
+    /*  10 */ 39045157, 49367440, 61356676, 76695844, 95443717,
+    /*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+void fair_init_entity(sched_entity_t *se, void *owner, int nice) {
+    se->owner = owner;
+    if(nice < NICE_MIN)
+        nice = NICE_MIN;
+    else if(nice > NICE_MAX)
+        nice = NICE_MAX;
+    se->nice = nice;
+    se->weight = nice_to_weight[nice - NICE_MIN];
+    se->inv_weight = nice_to_wmult[nice - NICE_MIN];
+    se->vruntime = 0;
+    se->sum_exec = 0;
+    se->slice_start = 0;
+    se->on_rq = 0;
+    se->red = 0;
+    se->left = NULL;
+    se->right = NULL;
+    se->parent = NULL;
+}
+
+void fair_init_timeline(timeline_t *tl) {
+    tl->nr_running = 0;
+    tl->load = 0;
+    tl->min_vruntime = 0;
+    tl->root = NULL;
+    tl->first = NULL;
+    tl->curr = NULL;
+}
+
+/**
+ * Converts real runtime to virtual runtime: delta * NICE_0_LOAD / weight
+ */
+static uint64_t fair_delta(sched_entity_t *se, uint32_t delta) {
+    if(se->weight == NICE_0_LOAD)
+        return delta;
+    // NICE_0_LOAD is 2^10, so (delta * 2^10 * inv_weight) >> 32
+    return ((uint64_t) delta * se->inv_weight) >> 22;
+}
+
+/**
+ * Signed comparison, it keeps working when vruntime wraps
+ */
+static int64_t vruntime_diff(uint64_t a, uint64_t b) {
+    return (int64_t) (a - b);
+}
+
+/**
+ * Puts child in the place of se under the parent of se
+ */
+static void timeline_replace(timeline_t *tl, sched_entity_t *se, sched_entity_t *child) {
+    if(se->parent == NULL)
+        tl->root = child;
+    else if(se == se->parent->left)
+        se->parent->left = child;
+    else
+        se->parent->right = child;
+}
+
+static void rotate_left(timeline_t *tl, sched_entity_t *se) {
+    sched_entity_t *right = se->right;
+    se->right = right->left;
+    if(right->left)
+        right->left->parent = se;
+    right->parent = se->parent;
+    timeline_replace(tl, se, right);
+    right->left = se;
+    se->parent = right;
+}
+
+static void rotate_right(timeline_t *tl, sched_entity_t *se) {
+    sched_entity_t *left = se->left;
+    se->left = left->right;
+    if(left->right)
+        left->right->parent = se;
+    left->parent = se->parent;
+    timeline_replace(tl, se, left);
+    left->right = se;
+    se->parent = left;
+}
+
+static int is_red(sched_entity_t *se) {
+    return (se != NULL) && se->red;
+}
+
+static sched_entity_t *timeline_leftmost(sched_entity_t *se) {
+    while(se->left)
+        se = se->left;
+    return se;
+}
+
+static void timeline_insert(timeline_t *tl, sched_entity_t *se) {
+    sched_entity_t **link = &tl->root;
+    sched_entity_t *parent = NULL;
+    int leftmost = 1;
+    // Entities with the same vruntime keep their arrival order
+    while(*link) {
+        parent = *link;
+        if(vruntime_diff(se->vruntime, parent->vruntime) < 0) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+    se->parent = parent;
+    se->left = NULL;
+    se->right = NULL;
+    se->red = 1;
+    *link = se;
+    if(leftmost)
+        tl->first = se;
+    
+    // Two red entities in a row, recolor or rotate up to the root
+    while(is_red(se->parent)) {
+        parent = se->parent;
+        sched_entity_t *gparent = parent->parent;
+        if(parent == gparent->left) {
+            sched_entity_t *uncle = gparent->right;
+            if(is_red(uncle)) {
+                parent->red = 0;
+                uncle->red = 0;
+                gparent->red = 1;
+                se = gparent;
+                continue;
+            }
+            if(se == parent->right) {
+                rotate_left(tl, parent);
+                sched_entity_t *tmp = parent;
+                parent = se;
+                se = tmp;
+            }
+            parent->red = 0;
+            gparent->red = 1;
+            rotate_right(tl, gparent);
+        } else {
+            sched_entity_t *uncle = gparent->left;
+            if(is_red(uncle)) {
+                parent->red = 0;
+                uncle->red = 0;
+                gparent->red = 1;
+                se = gparent;
+                continue;
+            }
+            if(se == parent->left) {
+                rotate_right(tl, parent);
+                sched_entity_t *tmp = parent;
+                parent = se;
+                se = tmp;
+            }
+            parent->red = 0;
+            gparent->red = 1;
+            rotate_left(tl, gparent);
+        }
+    }
+    tl->root->red = 0;
+}
+
+/**
+ * A black entity left the tree above child, the path through child is
+ * one black short
+ */
+static void timeline_remove_fixup(timeline_t *tl, sched_entity_t *child, sched_entity_t *parent) {
+    while((child != tl->root) && !is_red(child)) {
+        if(child == parent->left) {
+            sched_entity_t *sibling = parent->right;
+            if(sibling->red) {
+                sibling->red = 0;
+                parent->red = 1;
+                rotate_left(tl, parent);
+                sibling = parent->right;
+            }
+            if(!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = 1;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if(!is_red(sibling->right)) {
+                sibling->left->red = 0;
+                sibling->red = 1;
+                rotate_right(tl, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = 0;
+            sibling->right->red = 0;
+            rotate_left(tl, parent);
+        } else {
+            sched_entity_t *sibling = parent->left;
+            if(sibling->red) {
+                sibling->red = 0;
+                parent->red = 1;
+                rotate_right(tl, parent);
+                sibling = parent->left;
+            }
+            if(!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = 1;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if(!is_red(sibling->left)) {
+                sibling->right->red = 0;
+                sibling->red = 1;
+                rotate_left(tl, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = 0;
+            sibling->left->red = 0;
+            rotate_right(tl, parent);
+        }
+        // The rotation gave the short path its black back
+        child = tl->root;
+        break;
+    }
+    if(child)
+        child->red = 0;
+}
+
+static void timeline_remove(timeline_t *tl, sched_entity_t *se) {
+    // The leftmost entity has no left child, the next one is on its right or above
+    if(tl->first == se)
+        tl->first = se->right ? timeline_leftmost(se->right) : se->parent;
+    
+    // The entity taken out of its place: se, or its successor if se has two children
+    sched_entity_t *out = (se->left && se->right) ? timeline_leftmost(se->right) : se;
+    sched_entity_t *child = out->left ? out->left : out->right;
+    sched_entity_t *parent = out->parent;
+    int red = out->red;
+    
+    if(child)
+        child->parent = out->parent;
+    timeline_replace(tl, out, child);
+    
+    if(out != se) {
+        // The successor takes the place and the color of se
+        if(parent == se)
+            parent = out;
+        out->left = se->left;
+        out->right = se->right;
+        out->parent = se->parent;
+        out->red = se->red;
+        if(out->left)
+            out->left->parent = out;
+        if(out->right)
+            out->right->parent = out;
+        timeline_replace(tl, se, out);
+    }
+    if(!red)
+        timeline_remove_fixup(tl, child, parent);
+    
+    se->left = NULL;
+    se->right = NULL;
+    se->parent = NULL;
+}
+
+/**
+ * min_vruntime only moves forward, it's where new entities are placed
+ */
+static void update_min_vruntime(timeline_t *tl) {
+    uint64_t vruntime = tl->min_vruntime;
+    
+    if(tl->curr)
+        vruntime = tl->curr->vruntime;
+    if(tl->first) {
+        if(!tl->curr || vruntime_diff(tl->first->vruntime, vruntime) < 0)
+            vruntime = tl->first->vruntime;
+    }
+    if(vruntime_diff(vruntime, tl->min_vruntime) > 0)
+        tl->min_vruntime = vruntime;
+}
+
+/**
+ * New entities start after the ones already waiting, so they can't
+ * starve them. Entities that slept get at most half a period of credit.
+ */
+static void place_entity(timeline_t *tl, sched_entity_t *se, int initial) {
+    uint64_t vruntime = tl->min_vruntime;
+    
+    if(initial) {
+        if(tl->nr_running)
+            vruntime += fair_delta(se, SCHED_MIN_GRAN_NS);
+    } else {
+        vruntime -= SCHED_LATENCY_NS / 2;
+    }
+    
+    if(vruntime_diff(vruntime, se->vruntime) > 0)
+        se->vruntime = vruntime;
+}
+
+/**
+ * Makes an entity runnable on the timeline
+ */
+void fair_enqueue(timeline_t *tl, sched_entity_t *se, int initial) {
+    if(se->on_rq)
+        return;
+    place_entity(tl, se, initial);
+    if(tl->curr != se)
+        timeline_insert(tl, se);
+    se->on_rq = 1;
+    tl->nr_running++;
+    tl->load += se->weight;
+}
+
+/**
+ * Removes an entity from the timeline, the current one stays curr until
+ * the scheduler puts it back
+ */
+void fair_dequeue(timeline_t *tl, sched_entity_t *se) {
+    if(!se->on_rq)
+        return;
+    if(tl->curr != se)
+        timeline_remove(tl, se);
+    se->on_rq = 0;
+    tl->nr_running--;
+    tl->load -= se->weight;
+    update_min_vruntime(tl);
+}
+
+/**
+ * Takes the entity that ran the least out of the timeline and makes it current
+ */
+sched_entity_t *fair_pick(timeline_t *tl) {
+    sched_entity_t *se = tl->first;
+    if(se == NULL)
+        return NULL;
+    timeline_remove(tl, se);
+    tl->curr = se;
+    se->slice_start = se->sum_exec;
+    return se;
+}
+
+/**
+ * The current entity leaves the CPU, if it's still runnable it goes back
+ * in the timeline in its new position
+ */
+void fair_put(timeline_t *tl, sched_entity_t *se) {
+    if(tl->curr != se)
+        return;
+    tl->curr = NULL;
+    if(se->on_rq)
+        timeline_insert(tl, se);
+    update_min_vruntime(tl);
+}
+
+/**
+ * Charges delta ns of CPU time to the entity
+ */
+void fair_update(timeline_t *tl, sched_entity_t *se, uint32_t delta) {
+    se->sum_exec += delta;
+    se->vruntime += fair_delta(se, delta);
+    update_min_vruntime(tl);
+}
+
+/**
+ * Changes the weight of an entity, keeping the timeline ordered
+ */
+void fair_reweight(timeline_t *tl, sched_entity_t *se, int nice) {
+    int on_tree = se->on_rq && (tl->curr != se);
+    
+    if(on_tree)
+        timeline_remove(tl, se);
+    if(se->on_rq)
+        tl->load -= se->weight;
+    
+    if(nice < NICE_MIN)
+        nice = NICE_MIN;
+    else if(nice > NICE_MAX)
+        nice = NICE_MAX;
+    se->nice = nice;
+    se->weight = nice_to_weight[nice - NICE_MIN];
+    se->inv_weight = nice_to_wmult[nice - NICE_MIN];
+    
+    if(se->on_rq)
+        tl->load += se->weight;
+    if(on_tree)
+        timeline_insert(tl, se);
+}
+
+/**
+ * The part of period the entity gets, proportional to its weight
+ */
+uint64_t fair_slice(timeline_t *tl, sched_entity_t *se, uint64_t period) {
+    uint32_t load = tl->load;
+    if(!se->on_rq)
+        load += se->weight;
+    if(load == 0)
+        return period;
+    return div64(period * se->weight, load, NULL);
+}
+
+/**
+ * Checks if a woken entity ran enough less than the current one to take its place
+ */
+int fair_wakeup_preempt(sched_entity_t *curr, sched_entity_t *se) {
+    int64_t diff = vruntime_diff(curr->vruntime, se->vruntime);
+    return diff > (int64_t) fair_delta(se, SCHED_WAKEUP_GRAN_NS);
+}
+
+/**
+ * Moves an entity that isn't running to the timeline of another CPU, it
+ * keeps its distance from min_vruntime
+ */
+void fair_migrate(timeline_t *from, timeline_t *to, sched_entity_t *se) {
+    int on_rq = se->on_rq;
+    fair_dequeue(from, se);
+    se->vruntime = se->vruntime - from->min_vruntime + to->min_vruntime;
+    if(on_rq)
+        fair_enqueue(to, se, 0);
+}
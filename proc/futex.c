@@ -0,0 +1,90 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/futex.h>
+#include <proc/wait.h>
+#include <proc/proc.h>
+#include <proc/sched.h>
+#include <hal/clock.h>
+#include <mm/paging.h>
+
+// Zeroed queues are empty and unlocked
+static wait_queue_t futex_queues[FUTEX_HASH_SIZE];
+
+/**
+ * Futexes are keyed on the physical address of the word, so every thread
+ * of a process, which all share the same page directory, agrees on it
+ */
+static uint32_t futex_key(uint32_t *uaddr) {
+    if((uaddr == NULL) || ((uint32_t) uaddr & 3))
+        return 0;
+    uint32_t frame = (uint32_t) get_phys_addr(get_page_directory(), (vmm_addr_t) uaddr);
+    if(frame == 0)
+        return 0;
+    return frame | ((uint32_t) uaddr & 0xFFF);
+}
+
+static wait_queue_t *futex_queue(uint32_t key) {
+    return &futex_queues[(key >> 2) % FUTEX_HASH_SIZE];
+}
+
+/**
+ * Sleeps while *uaddr is val, returns -1 if the value had already changed
+ * or the timeout expired
+ */
+static int futex_wait(uint32_t *uaddr, uint32_t key, uint32_t val, const struct timespec *timeout) {
+    thread_t *cur = get_cur_thread();
+    wait_queue_t *queue = futex_queue(key);
+    
+    if(timeout && ((timeout->tv_sec < 0) || (timeout->tv_nsec < 0) || (timeout->tv_nsec >= NSEC_PER_SEC)))
+        return -1;
+    
+    // Queued before the check, a wake up after the store can't be missed
+    cur->wait_key = key;
+    prepare_to_wait(queue);
+    if(*(volatile uint32_t *) uaddr != val) {
+        finish_wait(queue);
+        return -1;
+    }
+    if(timeout)
+        ktimer_add(&cur->sleep_timer, clock_now() + (uint64_t) timeout->tv_sec * NSEC_PER_SEC + timeout->tv_nsec);
+    sched_block();
+    ktimer_del(&cur->sleep_timer);
+    
+    // Still queued means nobody called wake
+    int ret = (cur->waiting_on == queue) ? -1 : 0;
+    finish_wait(queue);
+    return ret;
+}
+
+/**
+ * Fast user space locking, waits on or wakes up the threads of the
+ * calling process sleeping on the word at uaddr
+ */
+int futex_sys(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout) {
+    uint32_t key = futex_key(uaddr);
+    if(key == 0)
+        return -1;
+    
+    switch(op) {
+        case FUTEX_WAIT:
+            return futex_wait(uaddr, key, val, timeout);
+        case FUTEX_WAKE:
+            return wake_up_key(futex_queue(key), key, (int) val);
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/io_ring.h>
+#include <proc/sched.h>
+#include <proc/thread.h>
+#include <hal/clock.h>
+#include <mm/memory.h>
+#include <fs/vfs.h>
+#include <console.h>
+#include <lib/string.h>
+
+/**
+ * Runs one submission, returns the value of its completion
+ */
+static int io_ring_op(struct io_sqe *sqe) {
+    switch(sqe->op) {
+        case IO_NOP:
+            return 0;
+        case IO_READ:
+            vfs_file_read((file *) sqe->arg1, (char *) sqe->arg2);
+            return 0;
+        case IO_WRITE:
+            vfs_file_write((file *) sqe->arg1, (char *) sqe->arg2);
+            return 0;
+        case IO_OPEN:
+            return (int) vfs_file_open_user((char *) sqe->arg1, (char *) sqe->arg2);
+        case IO_CLOSE:
+            vfs_file_close_user((file *) sqe->arg1);
+            return 0;
+        case IO_SLEEP:
+            sched_sleep(((uint64_t) sqe->arg2 << 32) | sqe->arg1);
+            return 0;
+        case IO_PRINT:
+            console_print("%s", (char *) sqe->arg1);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Runs up to max submissions and posts their completions, it stops
+ * early if the completion queue is full. Returns how many ran.
+ */
+static int io_ring_run(io_ctx_t *io, int max) {
+    struct io_ring *ring = io->ring;
+    int n = 0;
+    
+    mutex_lock(&io->lock);
+    while((n < max) && (ring->sq_head != ring->sq_tail)) {
+        if(ring->cq_tail - ring->cq_head >= IORING_CQ_ENTRIES)
+            break;
+        
+        // Copied, the user may reuse the entry once sq_head moves
+        struct io_sqe sqe = ring->sq[ring->sq_head & (IORING_ENTRIES - 1)];
+        ring->sq_head++;
+        
+        int res = io_ring_op(&sqe);
+        struct io_cqe *cqe = &ring->cq[ring->cq_tail & (IORING_CQ_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        ring->cq_tail++;
+        n++;
+    }
+    mutex_unlock(&io->lock);
+    
+    if(n)
+        wake_up_all(&io->cq_wait);
+    return n;
+}
+
+/**
+ * Kernel thread of a process set up with IORING_SETUP_SQPOLL, it takes
+ * the submissions as soon as they're queued and sleeps once the ring has
+ * been empty for a while
+ */
+static void io_poll_thread() {
+    io_ctx_t *io = get_cur_proc()->io;
+    struct io_ring *ring = io->ring;
+    uint64_t idle_since = clock_now();
+    
+    while(1) {
+        if(io_ring_run(io, IORING_ENTRIES)) {
+            idle_since = clock_now();
+            continue;
+        }
+        if(clock_now() - idle_since < IORING_IDLE_NS) {
+            sched_yield();
+            continue;
+        }
+        
+        // The flag is set before the last look at the queue
+        ring->flags |= IORING_SQ_NEED_WAKEUP;
+        wait_event(&io->sq_wait, ring->sq_head != ring->sq_tail);
+        ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+        idle_since = clock_now();
+    }
+}
+
+/**
+ * Maps the submission and completion rings of the calling process at
+ * IORING_ADDR, returns NULL if they already exist
+ */
+struct io_ring *io_setup_sys(int setup) {
+    process_t *proc = get_cur_proc();
+    if((proc == NULL) || (proc->io != NULL) || (proc->pdir == get_kern_directory()))
+        return NULL;
+    
+    io_ctx_t *io = (io_ctx_t *) kmalloc(sizeof(io_ctx_t));
+    if(io == NULL)
+        return NULL;
+    if(!vmm_map(proc->pdir, IORING_ADDR, PAGE_PRESENT | PAGE_RW | PAGE_USER)) {
+        kfree(io);
+        return NULL;
+    }
+    
+    // The address space is the current one
+    io->ring = (struct io_ring *) IORING_ADDR;
+    memset(io->ring, 0, sizeof(struct io_ring));
+    io->ring->setup = setup;
+    mutex_init(&io->lock);
+    wait_queue_init(&io->cq_wait);
+    wait_queue_init(&io->sq_wait);
+    io->poller = NULL;
+    proc->io = io;
+    
+    if(setup & IORING_SETUP_SQPOLL) {
+        io->poller = thread_create_kernel(&io_poll_thread);
+        if(io->poller == NULL)
+            io->ring->setup &= ~IORING_SETUP_SQPOLL;
+    }
+    return io->ring;
+}
+
+/**
+ * Runs up to to_submit submissions in the calling thread, or wakes up
+ * the poll thread, then waits for min_complete completions if asked.
+ * Returns how many submissions ran.
+ */
+int io_enter_sys(int to_submit, int min_complete, int flags) {
+    process_t *proc = get_cur_proc();
+    if((proc == NULL) || (proc->io == NULL))
+        return -1;
+    io_ctx_t *io = proc->io;
+    struct io_ring *ring = io->ring;
+    
+    int done = 0;
+    if(io->poller == NULL) {
+        done = io_ring_run(io, to_submit);
+        // Nothing else completes submissions, there's nothing to wait for
+        return done;
+    }
+    
+    if(flags & IORING_ENTER_SQ_WAKEUP)
+        wake_up(&io->sq_wait);
+    if(flags & IORING_ENTER_GETEVENTS)
+        wait_event(&io->cq_wait, ring->cq_tail - ring->cq_head >= (uint32_t) min_complete);
+    return done;
+}
+
+/**
+ * Frees the rings of a process that's being removed, its threads are
+ * stopped already
+ */
+void io_ring_free(process_t *proc) {
+    if(proc->io == NULL)
+        return;
+    vmm_unmap(proc->pdir, IORING_ADDR);
+    kfree(proc->io);
+    proc->io = NULL;
+}
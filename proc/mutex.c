@@ -0,0 +1,50 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/mutex.h>
+#include <proc/sched.h>
+
+void mutex_init(mutex_t *mutex) {
+    mutex->locked = 0;
+    mutex->owner = NULL;
+    wait_queue_init(&mutex->wait);
+}
+
+/**
+ * Takes the mutex if it's free, returns 1 on success
+ */
+int mutex_trylock(mutex_t *mutex) {
+    uint32_t old = 1;
+    asm volatile("xchg %0, %1" : "+r" (old), "+m" (mutex->locked) : : "memory");
+    if(old != 0)
+        return 0;
+    mutex->owner = get_cur_thread();
+    return 1;
+}
+
+/**
+ * Blocks until the mutex is free and takes it
+ */
+void mutex_lock(mutex_t *mutex) {
+    wait_event(&mutex->wait, mutex_trylock(mutex));
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    mutex->owner = NULL;
+    asm volatile("" : : : "memory");
+    mutex->locked = 0;
+    wake_up(&mutex->wait);
+}
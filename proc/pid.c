@@ -0,0 +1,93 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/pid.h>
+#include <proc/spinlock.h>
+
+/*
+ * Every thread id is taken from a bitmap and the live threads are found
+ * through a hash table, pid 0 is never given out
+ */
+static uint32_t pid_map[PID_MAX / 32];
+static int pid_last = 0;
+static thread_t *pid_hash[PID_HASH_SIZE];
+static spinlock_t pid_lock = SPINLOCK_INIT;
+
+#define pid_bucket(pid)     (&pid_hash[(pid) % PID_HASH_SIZE])
+
+/**
+ * Returns a free id, the search starts after the last one given out so
+ * a freed id isn't reused right away. Returns -1 if none is left.
+ */
+int pid_alloc() {
+    int flags = spin_lock_irqsave(&pid_lock);
+    int pid = pid_last;
+    for(int i = 0; i < PID_MAX; i++) {
+        pid = (pid + 1) % PID_MAX;
+        if((pid != 0) && !(pid_map[pid / 32] & (1 << (pid % 32)))) {
+            pid_map[pid / 32] |= 1 << (pid % 32);
+            pid_last = pid;
+            spin_unlock_irqrestore(&pid_lock, flags);
+            return pid;
+        }
+    }
+    spin_unlock_irqrestore(&pid_lock, flags);
+    return -1;
+}
+
+void pid_free(int pid) {
+    if((pid <= 0) || (pid >= PID_MAX))
+        return;
+    int flags = spin_lock_irqsave(&pid_lock);
+    pid_map[pid / 32] &= ~(1 << (pid % 32));
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+/**
+ * Makes the thread reachable by its id
+ */
+void pid_hash_add(thread_t *thread) {
+    int flags = spin_lock_irqsave(&pid_lock);
+    thread_t **bucket = pid_bucket(thread->pid);
+    thread->pid_next = *bucket;
+    *bucket = thread;
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+/**
+ * Takes the thread out of the table, nothing happens if it isn't there
+ */
+void pid_hash_remove(thread_t *thread) {
+    int flags = spin_lock_irqsave(&pid_lock);
+    thread_t **pos = pid_bucket(thread->pid);
+    while((*pos != NULL) && (*pos != thread))
+        pos = &(*pos)->pid_next;
+    if(*pos != NULL)
+        *pos = thread->pid_next;
+    thread->pid_next = NULL;
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+thread_t *pid_lookup(int pid) {
+    if((pid <= 0) || (pid >= PID_MAX))
+        return NULL;
+    int flags = spin_lock_irqsave(&pid_lock);
+    thread_t *thread = *pid_bucket(pid);
+    while((thread != NULL) && (thread->pid != pid))
+        thread = thread->pid_next;
+    spin_unlock_irqrestore(&pid_lock, flags);
+    return thread;
+}
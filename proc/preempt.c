@@ -0,0 +1,90 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/preempt.h>
+#include <proc/sched.h>
+#include <hal/latency.h>
+#include <hal/smp.h>
+
+static volatile int preempt_counts[MAX_CPUS] = { [0 ... MAX_CPUS - 1] = 1 };
+
+/*
+ * The count has to change on the CPU it was read on, a thread could move
+ * between reading smp_cpu_id and writing it
+ */
+static int preempt_irq_save() {
+    int flags;
+    asm volatile("pushf; pop %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+static void preempt_irq_restore(int flags) {
+    if(flags & 0x200)
+        asm volatile("sti" : : : "memory");
+}
+
+void preempt_disable_at(void *site) {
+    int flags = preempt_irq_save();
+    int cpu = smp_cpu_id();
+    if(preempt_counts[cpu]++ == 0)
+        latency_start(LATENCY_PREEMPT, site);
+    preempt_irq_restore(flags);
+}
+
+/**
+ * Leaves a critical section, once the CPU is out of all of them it
+ * switches if the timer asked for it in the meantime
+ */
+void preempt_enable_at(void *site, int resched) {
+    int flags = preempt_irq_save();
+    int cpu = smp_cpu_id();
+    int count = --preempt_counts[cpu];
+    if(count == 0)
+        latency_end(LATENCY_PREEMPT, site);
+    preempt_irq_restore(flags);
+    
+    // With the interrupts off the next interrupt takes care of it
+    if(resched && (count == 0) && (flags & 0x200))
+        sched_preempt();
+}
+
+void preempt_disable() {
+    preempt_disable_at(__builtin_return_address(0));
+}
+
+void preempt_enable() {
+    preempt_enable_at(__builtin_return_address(0), 1);
+}
+
+void preempt_enable_no_resched() {
+    preempt_enable_at(__builtin_return_address(0), 0);
+}
+
+int preempt_count() {
+    int flags = preempt_irq_save();
+    int count = preempt_counts[smp_cpu_id()];
+    preempt_irq_restore(flags);
+    return count;
+}
+
+/**
+ * The scheduler runs threads on the calling CPU from now on
+ */
+void preempt_start() {
+    int flags = preempt_irq_save();
+    preempt_counts[smp_cpu_id()] = 0;
+    preempt_irq_restore(flags);
+}
@@ -21,6 +21,9 @@
 #include <elf.h>
 #include <drivers/video.h>
 #include <proc/sched.h>
+#include <proc/pid.h>
+#include <proc/io_ring.h>
+#include <hal/vdso.h>
 #include <hal/hal.h>
 #include <lib/string.h>
 
@@ -39,55 +42,121 @@
  * |-------------------------------------| ---|
  */
 
+// Taken while building or removing an address space and for the process tree
+mutex_t proc_lock = MUTEX_INIT;
+
+// Terminated processes waiting for the reaper to free them
+static process_t *reap_list = NULL;
+static thread_t *thread_reap_list = NULL;
+static spinlock_t reap_lock = SPINLOCK_INIT;
+static wait_queue_t reap_wait = WAIT_QUEUE_INIT;
+
+// Requests for the loader, which builds address spaces from the kernel directory
+static load_request_t *load_list = NULL;
+static spinlock_t load_lock = SPINLOCK_INIT;
+static wait_queue_t load_wait = WAIT_QUEUE_INIT;
+
+// Address spaces left behind by execve, the reaper frees them too
+static old_space_t *old_spaces = NULL;
+
 /**
- * Starts a new process
+ * Makes parent the parent of a new process, proc_lock must be held
  */
-int start_proc(char *name, char *arguments) {
-    process_t *proc = (process_t *) kmalloc(sizeof(process_t));
-    strcpy(proc->name, name);
-    proc->state = PROC_NEW;
+static void proc_link(process_t *proc, process_t *parent) {
+    proc->pid = proc->thread_list->pid;
+    proc->parent = parent;
+    proc->ppid = parent ? parent->pid : 0;
+    if(parent) {
+        proc->sibling = parent->children;
+        parent->children = proc;
+    }
+}
 
+/**
+ * Frees what build_space made of an address space before it failed
+ */
+static void space_free(process_t *proc, thread_t *thread) {
+    elf_unload(proc);
+    if(thread->stack_limit) {
+        vmm_unmap(proc->pdir, thread->stack_limit - PAGE_SIZE);
+        vmm_unmap(proc->pdir, thread->stack_kernel_limit - PAGE_SIZE);
+    }
+    if(thread->heap) {
+        for(int i = 0; i < 4; i++)
+            vmm_unmap(proc->pdir, thread->heap + (i * PAGE_SIZE));
+    }
+    if(proc->vdso)
+        vmm_unmap(proc->pdir, VDSO_PROC_ADDR);
+    delete_address_space(proc->pdir);
+    proc->pdir = NULL;
+    proc->vdso = 0;
+}
+
+/**
+ * Builds an address space for the thread of proc and loads the executable,
+ * the main function gets args. proc_lock must be held and the kernel
+ * directory has to be the current one. Nothing is left behind on failure.
+ */
+static int build_space(process_t *proc, thread_t *thread, char *name, char **args) {
+    proc->image = NULL;
+    thread->stack_limit = 0;
+    thread->heap = 0;
+    
     // Create a new page directory
     proc->pdir = create_address_space();
     if(!proc->pdir) {
         console_print("Failed finding address space\n");
-        return PROC_STOPPED;
+        return 0;
     }
+    proc->vdso = vdso_map(proc->pdir);
     
-    proc->thread_list = create_thread();
-    if(proc->thread_list == NULL)
-        return PROC_STOPPED;
-    proc->thread_list->main = 1;
-    proc->thread_list->parent = (void *) proc;
+    proc->thread_list = thread;
+    thread->parent = (void *) proc;
 
-    if(!load_elf(name, proc->thread_list, proc->pdir)) {
-        sched_state(1);
-        return PROC_STOPPED;
-    }
-    
-    if(!build_stack(proc->thread_list, proc->pdir, 0)) {
+    uint32_t argc, argv;
+    int ret = 0;
+    if(!load_elf(name, proc)) {
+        // load_elf says why
+    } else if(!build_stack(thread, proc->pdir, 0)) {
         console_print("Failed allocating memory, error 1\n");
-        sched_state(1);
-        return PROC_STOPPED;
-    }
-    
-    if(!build_heap(proc->thread_list, proc->pdir, 0)) {
+    } else if(!build_heap(thread, proc->pdir, 0)) {
         console_print("Failed allocating memory, error 2\n");
-        sched_state(1);
-        return PROC_STOPPED;
+    } else if(!heap_fill(thread, args, &argc, &argv)) {
+        console_print("Failed allocating memory, error 3\n");
+    } else if(!stack_fill(thread, argc, argv)) {
+        console_print("Failed allocating memory, error 4\n");
+    } else {
+        ret = 1;
     }
     
-    uint32_t argc, argv;
+    if(!ret)
+        space_free(proc, thread);
+    return ret;
+}
+
+/**
+ * Builds the address space of a new process and loads its executable
+ */
+static int load_proc(char *name, char **args, process_t *parent) {
+    process_t *proc = (process_t *) kmalloc(sizeof(process_t));
+    if(proc == NULL)
+        return PROC_STOPPED;
+    strncpy(proc->name, name, sizeof(proc->name) - 1);
+    proc->name[sizeof(proc->name) - 1] = '\0';
+    proc->state = PROC_NEW;
+    sched_init_proc(proc, NICE_DEFAULT);
     
-    if(!heap_fill(proc->thread_list, name, arguments, &argc, &argv)) {
-        console_print("Failed allocating memory, error 3\n");
-        sched_state(1);
+    thread_t *thread = create_thread();
+    if(thread == NULL) {
+        kfree(proc);
         return PROC_STOPPED;
     }
+    thread->main = 1;
     
-    if(!stack_fill(proc->thread_list, argc, argv)) {
-        console_print("Failed allocating memory, error 4\n");
-        sched_state(1);
+    if(!build_space(proc, thread, name, args)) {
+        pid_free(thread->pid);
+        kfree(thread);
+        kfree(proc);
         return PROC_STOPPED;
     }
     
@@ -96,10 +165,316 @@ int start_proc(char *name, char *arguments) {
     proc->thread_list->state = PROC_ACTIVE;
     proc->state = PROC_ACTIVE;
     
+    proc_link(proc, parent);
     sched_add_proc(proc);
     return proc->thread_list->pid;
 }
 
+/**
+ * Frees an argument vector made by args_split or args_copy
+ */
+void args_free(char **args) {
+    if(args == NULL)
+        return;
+    for(int i = 0; args[i]; i++)
+        kfree(args[i]);
+    kfree(args);
+}
+
+/**
+ * Makes a NULL terminated argument vector of name followed by the words of arguments
+ */
+static char **args_split(char *name, char *arguments) {
+    int argc = 1;
+    for(char *p = arguments; *p; p++) {
+        if((*p != ' ') && ((p == arguments) || (p[-1] == ' ')))
+            argc++;
+    }
+    
+    char **args = (char **) kmalloc((argc + 1) * sizeof(char *));
+    args[0] = (char *) kmalloc(strlen(name) + 1);
+    strcpy(args[0], name);
+    argc = 1;
+    while(*arguments) {
+        if(*arguments == ' ') {
+            arguments++;
+            continue;
+        }
+        int len = 0;
+        while(arguments[len] && (arguments[len] != ' '))
+            len++;
+        args[argc] = (char *) kmalloc(len + 1);
+        memcpy(args[argc], arguments, len);
+        args[argc][len] = '\0';
+        argc++;
+        arguments += len;
+    }
+    args[argc] = NULL;
+    return args;
+}
+
+/**
+ * Copies a path and a NULL terminated argument vector from the calling
+ * program into the kernel heap, argv NULL means just the path. Returns
+ * the vector, with the path after its NULL, or NULL if it's longer than PROC_ARG_MAX.
+ */
+static char **args_copy(char *path, char **argv) {
+    if(path == NULL)
+        return NULL;
+    
+    int argc = 0;
+    uint32_t size = strlen(path) + 1;
+    if(argv == NULL) {
+        size += size;
+        argc = 1;
+    } else {
+        for(; argv[argc]; argc++) {
+            size += strlen(argv[argc]) + 1 + sizeof(char *);
+            if(size > PROC_ARG_MAX)
+                return NULL;
+        }
+    }
+    if(size > PROC_ARG_MAX)
+        return NULL;
+    
+    char **args = (char **) kmalloc((argc + 2) * sizeof(char *));
+    if(args == NULL)
+        return NULL;
+    memset(args, 0, (argc + 2) * sizeof(char *));
+    for(int i = 0; i < argc; i++) {
+        char *arg = argv ? argv[i] : path;
+        args[i] = (char *) kmalloc(strlen(arg) + 1);
+        if(args[i] == NULL) {
+            args_free(args);
+            return NULL;
+        }
+        strcpy(args[i], arg);
+    }
+    args[argc + 1] = (char *) kmalloc(strlen(path) + 1);
+    if(args[argc + 1] == NULL) {
+        args_free(args);
+        return NULL;
+    }
+    strcpy(args[argc + 1], path);
+    return args;
+}
+
+/**
+ * Path saved by args_copy
+ */
+static char *args_path(char **args) {
+    while(*args)
+        args++;
+    return args[1];
+}
+
+static void args_copy_free(char **args) {
+    kfree(args_path(args));
+    args_free(args);
+}
+
+/**
+ * Starts a new process, the caller has to be a kernel process
+ */
+int start_proc(char *name, char *arguments) {
+    char **args = args_split(name, arguments);
+    // The image is built through the kernel directory, one at a time
+    mutex_lock(&proc_lock);
+    int pid = load_proc(name, args, get_cur_proc());
+    mutex_unlock(&proc_lock);
+    args_free(args);
+    return pid;
+}
+
+static load_request_t *proc_load_next() {
+    int flags = spin_lock_irqsave(&load_lock);
+    load_request_t *req = load_list;
+    if(req)
+        load_list = req->next;
+    spin_unlock_irqrestore(&load_lock, flags);
+    return req;
+}
+
+/**
+ * Kernel process building the address spaces asked by posix_spawn and
+ * execve, a program can't do it from its own address space
+ */
+void proc_loader() {
+    while(1) {
+        load_request_t *req;
+        wait_event(&load_wait, (req = proc_load_next()) != NULL);
+        
+        mutex_lock(&proc_lock);
+        if(req->space)
+            req->ret = build_space(req->space, req->space->thread_list, args_path(req->args), req->args);
+        else
+            req->ret = load_proc(args_path(req->args), req->args, req->parent);
+        mutex_unlock(&proc_lock);
+        
+        req->done = 1;
+        wake_up(&req->wait);
+    }
+}
+
+/**
+ * Hands a request to the loader and waits for it, returns what the loader did
+ */
+static int proc_load(load_request_t *req) {
+    req->ret = 0;
+    req->done = 0;
+    wait_queue_init(&req->wait);
+    
+    int flags = spin_lock_irqsave(&load_lock);
+    req->next = load_list;
+    load_list = req;
+    spin_unlock_irqrestore(&load_lock, flags);
+    wake_up(&load_wait);
+    
+    wait_event(&req->wait, req->done);
+    return req->ret;
+}
+
+/**
+ * Starts the program at path as a child of the calling process, argv is
+ * NULL terminated. Returns the id of the new process, -1 on error.
+ */
+int posix_spawn_sys(char *path, char **argv) {
+    process_t *cur = get_cur_proc();
+    if(cur == NULL)
+        return -1;
+    char **args = args_copy(path, argv);
+    if(args == NULL)
+        return -1;
+    
+    // The loader reads the request from the kernel directory
+    load_request_t *req = (load_request_t *) kmalloc(sizeof(load_request_t));
+    if(req == NULL) {
+        args_copy_free(args);
+        return -1;
+    }
+    req->args = args;
+    req->parent = cur;
+    req->space = NULL;
+    int pid = proc_load(req);
+    kfree(req);
+    args_copy_free(args);
+    return (pid != PROC_STOPPED) ? pid : -1;
+}
+
+/**
+ * Replaces the program of the calling process with the one at path, the
+ * process keeps its id, its parent and its children. The process must
+ * have a single thread. It only returns, with -1, if the new program can't be loaded.
+ */
+int execve_sys(char *path, char **argv) {
+    process_t *cur = get_cur_proc();
+    thread_t *thread = get_cur_thread();
+    if((cur == NULL) || (cur->pdir == get_kern_directory()) || (cur->threads != 1))
+        return -1;
+    char **args = args_copy(path, argv);
+    if(args == NULL)
+        return -1;
+    
+    // The new address space is built aside, the old one is still running
+    load_request_t *req = (load_request_t *) kmalloc(sizeof(load_request_t));
+    process_t *space = (process_t *) kmalloc(sizeof(process_t));
+    thread_t *next = (thread_t *) kmalloc(sizeof(thread_t));
+    // The old address space is handed to the reaper in any case
+    old_space_t *old = (old_space_t *) kmalloc(sizeof(old_space_t));
+    if(!req || !space || !next || !old) {
+        void *blocks[] = { req, space, next, old };
+        for(uint32_t i = 0; i < sizeof(blocks) / sizeof(void *); i++) {
+            if(blocks[i])
+                kfree(blocks[i]);
+        }
+        args_copy_free(args);
+        return -1;
+    }
+    memset(space, 0, sizeof(process_t));
+    memset(next, 0, sizeof(thread_t));
+    space->thread_list = next;
+    req->args = args;
+    req->parent = NULL;
+    req->space = space;
+    int ret = proc_load(req);
+    kfree(req);
+    
+    if(!ret) {
+        // The loader already freed whatever it built
+        args_copy_free(args);
+        kfree(next);
+        kfree(old);
+        kfree(space);
+        return -1;
+    }
+    
+    char *name = args_path(args);
+    for(char *p = name; *p; p++) {
+        if(*p == '/')
+            name = p + 1;
+    }
+    strncpy(cur->name, name, sizeof(cur->name) - 1);
+    cur->name[sizeof(cur->name) - 1] = '\0';
+    args_copy_free(args);
+    
+    // Only the kernel stack this code runs on is left of the old program
+    io_ring_free(cur);
+    elf_unload(cur);
+    vmm_unmap(cur->pdir, thread->stack_limit - PAGE_SIZE);
+    for(int i = 0; i < 4; i++)
+        vmm_unmap(cur->pdir, thread->heap + (i * PAGE_SIZE));
+    if(cur->vdso) {
+        cur->vdso = 0;
+        vmm_unmap(cur->pdir, VDSO_PROC_ADDR);
+    }
+    old->pdir = cur->pdir;
+    old->stack = thread->stack_kernel_limit - PAGE_SIZE;
+    
+    // The scheduler only looks at these while the thread is in the kernel
+    thread->eip = next->eip;
+    thread->esp = next->esp;
+    thread->stack_limit = next->stack_limit;
+    thread->heap = next->heap;
+    thread->heap_limit = next->heap_limit;
+    thread->image_base = next->image_base;
+    thread->image_size = next->image_size;
+    uint32_t esp_kernel = next->esp_kernel;
+    uint32_t stack_kernel_limit = next->stack_kernel_limit;
+    page_dir_t *pdir = space->pdir;
+    int vdso = space->vdso;
+    cur->image = space->image;
+    kfree(next);
+    kfree(space);
+    
+    // The thread can't be switched out until it runs on the new kernel stack
+    disable_int();
+    cur->old_space = old;
+    cur->pdir = pdir;
+    cur->vdso = vdso;
+    thread->esp_kernel = esp_kernel;
+    thread->stack_kernel_limit = stack_kernel_limit;
+    set_esp0(stack_kernel_limit);
+    exec_switch(pdir, esp_kernel);
+    return -1;
+}
+
+/**
+ * Runs on the new kernel stack of a thread that just called execve, the
+ * old address space can go to the reaper now that nothing runs on it
+ */
+void exec_finish() {
+    process_t *cur = get_cur_proc();
+    old_space_t *old = cur->old_space;
+    cur->old_space = NULL;
+    vdso_switch(get_cur_thread());
+    
+    int flags = spin_lock_irqsave(&reap_lock);
+    old->next = old_spaces;
+    old_spaces = old;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    wake_up(&reap_wait);
+}
+
 /**
  *Builds the stack for a thread
  */
@@ -128,6 +503,8 @@ int build_stack(thread_t *thread, page_dir_t *pdir, int nthreads) {
  */
 int build_heap(thread_t *thread, page_dir_t *pdir, int nthreads) {
     vmm_addr_t heap = thread->stack_kernel_limit + (PAGE_SIZE * 6 * nthreads);
+    // Set first so the pages mapped before a failure can be found
+    thread->heap = heap;
     
     for(int i = 0; i < 4; i++) {
         if(!vmm_map(get_kern_directory(), heap + (i * PAGE_SIZE), PAGE_PRESENT | PAGE_RW) ||
@@ -144,31 +521,24 @@ int build_heap(thread_t *thread, page_dir_t *pdir, int nthreads) {
 }
 
 /**
- * Fills the heap with arguments
+ * Copies the NULL terminated argument vector into the heap, main gets
+ * argc and argv. Only the heap size limits the arguments.
  */
-int heap_fill(thread_t *thread, char *name, char *arguments, uint32_t *argc, uint32_t *argv1) {
-    *argc = 1;
-    char **argv = (char **) umalloc(10 * sizeof(char *), (vmm_addr_t *) thread->heap);
-    argv[0] = (char *) umalloc(strlen(name) + 1, (vmm_addr_t *) thread->heap);
-    strcpy(argv[0], name);
-    
-    while(*arguments) {
-        char *p = strchr(arguments, ' ');
-        if(p == NULL) {
-            argv[*argc] = (char *) umalloc(strlen(arguments) + 1, (vmm_addr_t *) thread->heap);
-            strcpy(argv[*argc], arguments);
-            (*argc)++;
-            break;
-        }
-        int strl = strlen(arguments) - strlen(p);
-        argv[*argc] = (char *) umalloc(strl + 1, (vmm_addr_t *) thread->heap);
-        strncpy(argv[*argc], arguments, strl);
+int heap_fill(thread_t *thread, char **args, uint32_t *argc, uint32_t *argv1) {
+    *argc = 0;
+    while(args[*argc])
         (*argc)++;
-        while(strl--) {
-            arguments++;
-        }
-        arguments++;
+    
+    char **argv = (char **) umalloc((*argc + 1) * sizeof(char *), (vmm_addr_t *) thread->heap);
+    if(argv == NULL)
+        return 0;
+    for(uint32_t i = 0; i < *argc; i++) {
+        argv[i] = (char *) umalloc(strlen(args[i]) + 1, (vmm_addr_t *) thread->heap);
+        if(argv[i] == NULL)
+            return 0;
+        strcpy(argv[i], args[i]);
     }
+    argv[*argc] = NULL;
     *argv1 = (uint32_t) argv;
     vmm_unmap_phys(get_kern_directory(), (uint32_t) thread->heap);
     
@@ -186,8 +556,18 @@ int stack_fill(thread_t *thread, uint32_t argc, uint32_t argv) {
     *--stackp = (uint32_t) RETURN_ADDR;     // The process needs to know where to return
     thread->esp = (uint32_t) stackp;
     
-    // Fill kernel stack
-    stackp = (uint32_t *) thread->stack_kernel_limit;
+    kernel_stack_fill(thread);
+    
+    vmm_unmap_phys(get_kern_directory(), (uint32_t) thread->esp);
+    
+    return 1;
+}
+
+/**
+ * Builds the interrupt frame the thread starts from in user mode
+ */
+void kernel_stack_fill(thread_t *thread) {
+    uint32_t *stackp = (uint32_t *) thread->stack_kernel_limit;
     *--stackp = 0x23;                                       // ss
     *--stackp = thread->esp;                                // esp
     *--stackp = 0x202;                                      // eflags
@@ -205,22 +585,16 @@ int stack_fill(thread_t *thread, uint32_t argc, uint32_t argv) {
     *--stackp = 0x23;                                       // fs
     *--stackp = 0x23;                                       // gs
     thread->esp_kernel = (uint32_t) stackp;
-    
-    vmm_unmap_phys(get_kern_directory(), (uint32_t) thread->esp);
-    
-    return 1;
 }
 
 /**
- * Terminates a process and frees all the memory 
+ * Terminates the calling process, the reaper frees its memory once this
+ * thread is off its CPU and waitpid collects the exit status
  */
 void end_proc(int ret) {
-    sched_state(0);
-
     process_t *cur = get_cur_proc();
     if(cur == NULL) {
         console_print("Process not found\n");
-        sched_state(1);
         enable_int();
         while(1);
     }
@@ -228,51 +602,273 @@ void end_proc(int ret) {
     if(ret)
         console_print("Process %d returned with error: %d\n", cur->thread_list->pid, ret);
     
-    cur->state = PROC_STOPPED;
+    cur->exit_code = ret;
+    cur->state = PROC_ZOMBIE;
+    
+    // None of the threads can run anymore
+    thread_t *thread = cur->thread_list;
+    for(int i = 0; i < cur->threads; i++) {
+        sched_stop_thread(thread);
+        thread = thread->next;
+    }
+    
+    wake_up_all(&cur->wait);
     
-    sched_state(1);
-    enable_int();
-    while(1);
+    int flags = spin_lock_irqsave(&reap_lock);
+    cur->reap_next = reap_list;
+    reap_list = cur;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    wake_up(&reap_wait);
+    
+    // Stopped, it won't be scheduled again
+    while(1)
+        sched_yield();
 }
 
 /**
- * Removes a terminated process
+ * Frees the threads and the address space of a terminated process, only
+ * the process_t with the exit status is left
+ */
+/**
+ * Frees a thread that isn't from thread_create, the caller holds proc_lock
  */
-void remove_proc(int pid) {
-    process_t *cur = get_proc_by_id(pid);
+static void proc_thread_release(process_t *cur, thread_t *thread) {
+    if(cur->pdir != get_kern_directory()) {
+        vmm_unmap(cur->pdir, thread->stack_limit - PAGE_SIZE);
+        vmm_unmap(cur->pdir, thread->stack_kernel_limit - PAGE_SIZE);
+        for(int i = 0; i < 4; i++) {
+            vmm_unmap(cur->pdir, thread->heap + (i * PAGE_SIZE));
+        }
+    } else {
+        // Kernel processes have no heap and their stacks were kmalloc'd
+        kfree((void *) (thread->stack_limit - PAGE_SIZE));
+    }
+    pid_hash_remove(thread);
+    // The process id stays taken until waitpid
+    if(!thread->main)
+        pid_free(thread->pid);
+    fpu_free(thread);
+    kfree(thread);
+}
+
+static void proc_release(process_t *cur) {
+    // The last thread might still be leaving its CPU
+    while(sched_proc_running(cur))
+        sched_yield();
+    
+    // Its stopped threads are freed with it
+    int flags = spin_lock_irqsave(&reap_lock);
+    thread_t **link = &thread_reap_list;
+    while(*link) {
+        if((*link)->parent == (void *) cur)
+            *link = (*link)->reap_next;
+        else
+            link = &(*link)->reap_next;
+    }
+    spin_unlock_irqrestore(&reap_lock, flags);
+    
+    mutex_lock(&proc_lock);
+    sched_remove_proc(cur->pid);
     
     // Remove the executable
-    for(uint32_t page = 0; page < cur->thread_list->image_size / PAGE_SIZE; page++) {
-        vmm_unmap(cur->pdir, cur->thread_list->image_base + (page * PAGE_SIZE));
-    }
+    int user = (cur->pdir != get_kern_directory());
+    if(user)
+        elf_unload(cur);
     
     for(int i = 0; i < cur->threads; i++) {
-        if(cur->thread_list->main == 1) {
-            sched_remove_proc(cur->thread_list->pid);
+        thread_t *thread = cur->thread_list;
+        cur->thread_list = cur->thread_list->next;
+        
+        // Slot threads share the heap of the process
+        if(thread->slot < 0) {
+            proc_thread_release(cur, thread);
+        } else {
+            thread_free(thread, cur->pdir);
         }
-        vmm_unmap(cur->pdir, cur->thread_list->stack_limit - PAGE_SIZE);
-        vmm_unmap(cur->pdir, cur->thread_list->stack_kernel_limit - PAGE_SIZE);
-        for(int i = 0; i < 4; i++) {
-            vmm_unmap(cur->pdir, cur->thread_list->heap + (i * PAGE_SIZE));
+    }
+    cur->thread_list = NULL;
+    cur->threads = 0;
+    
+    io_ring_free(cur);
+    if(cur->vdso)
+        vmm_unmap(cur->pdir, VDSO_PROC_ADDR);
+    if(user)
+        delete_address_space(cur->pdir);
+    cur->reaped = 1;
+    mutex_unlock(&proc_lock);
+}
+
+static void proc_free(process_t *proc) {
+    pid_free(proc->pid);
+    kfree(proc);
+}
+
+static old_space_t *proc_old_space_next() {
+    int flags = spin_lock_irqsave(&reap_lock);
+    old_space_t *old = old_spaces;
+    if(old)
+        old_spaces = old->next;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    return old;
+}
+
+/**
+ * Frees an address space left by execve
+ */
+static void proc_old_space_release(old_space_t *old) {
+    mutex_lock(&proc_lock);
+    vmm_unmap(old->pdir, old->stack);
+    delete_address_space(old->pdir);
+    mutex_unlock(&proc_lock);
+    kfree(old);
+}
+
+/**
+ * Hands a stopping thread that isn't from thread_create to the reaper
+ */
+void proc_reap_thread(thread_t *thread) {
+    int flags = spin_lock_irqsave(&reap_lock);
+    thread->reap_next = thread_reap_list;
+    thread_reap_list = thread;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    wake_up(&reap_wait);
+}
+
+static thread_t *proc_reap_thread_next() {
+    int flags = spin_lock_irqsave(&reap_lock);
+    thread_t *thread = thread_reap_list;
+    if(thread)
+        thread_reap_list = thread->reap_next;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    return thread;
+}
+
+static process_t *proc_reap_next() {
+    int flags = spin_lock_irqsave(&reap_lock);
+    process_t *proc = reap_list;
+    if(proc)
+        reap_list = proc->reap_next;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    return proc;
+}
+
+/**
+ * Kernel process freeing the terminated processes in the background,
+ * then it tells their parent. It frees the address spaces execve left and
+ * the stopped threads too.
+ */
+void proc_reaper() {
+    while(1) {
+        process_t *proc = NULL;
+        old_space_t *old = NULL;
+        thread_t *thread = NULL;
+        wait_event(&reap_wait, ((old = proc_old_space_next()) != NULL) || ((thread = proc_reap_thread_next()) != NULL) || ((proc = proc_reap_next()) != NULL));
+        if(old) {
+            proc_old_space_release(old);
+            continue;
         }
+        if(thread) {
+            // It queued itself before stopping and leaving its CPU
+            while((thread->state != PROC_STOPPED) || sched_thread_running(thread))
+                sched_yield();
+            mutex_lock(&proc_lock);
+            sched_remove_thread(thread);
+            proc_thread_release((process_t *) thread->parent, thread);
+            mutex_unlock(&proc_lock);
+            continue;
+        }
+        proc_release(proc);
         
-        thread_t *thread = cur->thread_list;
-        cur->thread_list = cur->thread_list->next;
-        kfree(thread);
+        mutex_lock(&proc_lock);
+        // Nobody will wait for the children anymore
+        process_t *child = proc->children;
+        while(child) {
+            process_t *next = child->sibling;
+            child->parent = NULL;
+            child->ppid = 0;
+            if(child->reaped)
+                proc_free(child);
+            child = next;
+        }
+        proc->children = NULL;
+        
+        process_t *parent = proc->parent;
+        if(parent)
+            parent->child_events++;
+        else
+            proc_free(proc);
+        mutex_unlock(&proc_lock);
+        
+        // Only the reaper frees a parent that wasn't reaped yet
+        if(parent)
+            wake_up_all(&parent->child_wait);
     }
-    
-    change_page_directory(get_kern_directory());
-    delete_address_space(cur->pdir);
-    kfree(cur);
 }
 
 /**
- * Creates a kernel process from a function
+ * Waits for a child of the calling process to terminate, pid -1 means
+ * any child. Stores its exit code in status and returns its id, -1 if
+ * there's no such child.
  */
-int start_kernel_proc(char *name, void *addr) {
+int waitpid_sys(int pid, int *status) {
+    process_t *cur = get_cur_proc();
+    if(cur == NULL)
+        return -1;
+    
+    while(1) {
+        int found = 0;
+        mutex_lock(&proc_lock);
+        process_t **pos = &cur->children;
+        while(*pos != NULL) {
+            process_t *child = *pos;
+            if((pid == -1) || (child->pid == pid)) {
+                found = 1;
+                if(child->reaped) {
+                    *pos = child->sibling;
+                    mutex_unlock(&proc_lock);
+                    
+                    int id = child->pid;
+                    if(status != NULL)
+                        *status = child->exit_code;
+                    proc_free(child);
+                    return id;
+                }
+            }
+            pos = &child->sibling;
+        }
+        uint32_t seen = cur->child_events;
+        mutex_unlock(&proc_lock);
+        
+        if(!found)
+            return -1;
+        wait_event(&cur->child_wait, cur->child_events != seen);
+    }
+}
+
+/**
+ * Id of the calling process
+ */
+int getpid_sys() {
+    process_t *cur = get_cur_proc();
+    return cur ? cur->pid : 0;
+}
+
+/**
+ * Id of the process that started the calling one, 0 if it's gone
+ */
+int getppid_sys() {
+    process_t *cur = get_cur_proc();
+    return cur ? cur->ppid : 0;
+}
+
+/**
+ * Builds the stack of a kernel process running the function
+ */
+static int load_kernel_proc(char *name, void *addr) {
     process_t *proc = (process_t *) kmalloc(sizeof(process_t));
     strcpy(proc->name, name);
     proc->state = PROC_NEW;
+    sched_init_proc(proc, NICE_DEFAULT);
     proc->pdir = get_kern_directory();
     proc->thread_list = create_thread();
     if(proc->thread_list == NULL)
@@ -281,16 +877,17 @@ int start_kernel_proc(char *name, void *addr) {
     proc->thread_list->parent = (void *) proc;
     proc->thread_list->eip = (uint32_t) addr;
     
-    vmm_map(proc->pdir, (vmm_addr_t) KERNEL_SPACE_END + 0x5000, PAGE_PRESENT | PAGE_RW);
+    // Every kernel process shares the kernel directory, the stacks come from the kernel heap
+    uint32_t stack = (uint32_t) kmalloc(PAGE_SIZE * 2);
+    if(!stack)
+        return PROC_STOPPED;
 
-    proc->thread_list->esp = (uint32_t) KERNEL_SPACE_END + 0x5000;
+    proc->thread_list->esp = stack;
     proc->thread_list->stack_limit = ((uint32_t) proc->thread_list->esp + PAGE_SIZE);
     
     proc->thread_list->esp_kernel = proc->thread_list->stack_limit;
     proc->thread_list->stack_kernel_limit = proc->thread_list->esp_kernel + PAGE_SIZE;
     
-    vmm_map(proc->pdir, proc->thread_list->esp_kernel, PAGE_PRESENT | PAGE_RW);
-    
     uint32_t *stackp = (uint32_t *) proc->thread_list->stack_kernel_limit;
     *--stackp = 0x10;                     // ss
     *--stackp = proc->thread_list->esp;   // esp
@@ -314,14 +911,29 @@ int start_kernel_proc(char *name, void *addr) {
     proc->thread_list->state = PROC_ACTIVE;
     proc->state = PROC_ACTIVE;
     
+    proc_link(proc, get_cur_proc());
     sched_add_proc(proc);
     return proc->thread_list->pid;
 }
 
+/**
+ * Creates a kernel process from a function
+ */
+int start_kernel_proc(char *name, void *addr) {
+    mutex_lock(&proc_lock);
+    int pid = load_kernel_proc(name, addr);
+    mutex_unlock(&proc_lock);
+    return pid;
+}
+
 /**
  * Returns given id process state
  */
 int proc_state(int id) {
     process_t *cur = get_proc_by_id(id);
+    // Reaped or never existed
+    if(cur == NULL)
+        return PROC_ZOMBIE;
     return cur->state;
 }
+
@@ -0,0 +1,119 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/rt.h>
+#include <lib/sched.h>
+
+void rt_init_entity(rt_entity_t *rt, void *owner) {
+    rt->owner = owner;
+    rt->policy = SCHED_OTHER;
+    rt->prio = 0;
+    rt->slice = RT_RR_SLICE_NS;
+    rt->on_rq = 0;
+    rt->next = NULL;
+    rt->prec = NULL;
+}
+
+void rt_init_queue(rt_queue_t *q) {
+    q->nr_running = 0;
+    q->bitmap = 0;
+    for(int i = 0; i < RT_PRIO_MAX; i++) {
+        q->first[i] = NULL;
+        q->last[i] = NULL;
+    }
+    q->time = 0;
+    q->period_start = 0;
+    q->throttled = 0;
+}
+
+/**
+ * Makes an entity runnable, it goes after the others of its priority
+ */
+void rt_enqueue(rt_queue_t *q, rt_entity_t *rt) {
+    if(rt->on_rq)
+        return;
+    rt->next = NULL;
+    rt->prec = q->last[rt->prio];
+    if(rt->prec)
+        rt->prec->next = rt;
+    else
+        q->first[rt->prio] = rt;
+    q->last[rt->prio] = rt;
+    q->bitmap |= 1u << rt->prio;
+    rt->on_rq = 1;
+    q->nr_running++;
+}
+
+void rt_dequeue(rt_queue_t *q, rt_entity_t *rt) {
+    if(!rt->on_rq)
+        return;
+    if(rt->prec)
+        rt->prec->next = rt->next;
+    else
+        q->first[rt->prio] = rt->next;
+    if(rt->next)
+        rt->next->prec = rt->prec;
+    else
+        q->last[rt->prio] = rt->prec;
+    if(q->first[rt->prio] == NULL)
+        q->bitmap &= ~(1u << rt->prio);
+    rt->next = NULL;
+    rt->prec = NULL;
+    rt->on_rq = 0;
+    q->nr_running--;
+}
+
+/**
+ * Moves a runnable entity after the others of its priority, when it
+ * yields or its SCHED_RR slice ends
+ */
+void rt_requeue(rt_queue_t *q, rt_entity_t *rt) {
+    if(!rt->on_rq || (q->last[rt->prio] == rt))
+        return;
+    rt_dequeue(q, rt);
+    rt_enqueue(q, rt);
+}
+
+/**
+ * Walks the runnable entities from the one that runs first, NULL starts
+ * from the beginning
+ */
+rt_entity_t *rt_next(rt_queue_t *q, rt_entity_t *rt) {
+    int prio;
+    if(rt == NULL) {
+        prio = RT_PRIO_MAX - 1;
+    } else {
+        if(rt->next)
+            return rt->next;
+        prio = rt->prio - 1;
+    }
+    
+    // The highest priority with a runnable entity
+    uint32_t mask = (prio < 0) ? 0 : q->bitmap & ((2u << prio) - 1);
+    if(mask == 0)
+        return NULL;
+    asm volatile("bsr %1, %0" : "=r" (prio) : "r" (mask));
+    return q->first[prio];
+}
+
+/**
+ * Checks if a woken entity has to take the place of the current one
+ */
+int rt_preempt(rt_entity_t *curr, rt_entity_t *rt) {
+    if(!curr->on_rq)
+        return 1;
+    return rt->prio > curr->prio;
+}
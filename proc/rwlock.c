@@ -0,0 +1,74 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/rwlock.h>
+#include <proc/preempt.h>
+#include <hal/smp.h>
+
+/*
+ * Like a spinlock the holder can't be preempted, from taking the lock to
+ * releasing it, or the threads spinning on it would wait for its next slice
+ */
+
+void rwlock_init(rwlock_t *rw) {
+    spin_init(&rw->lock);
+    rw->readers = 0;
+    rw->writer = 0;
+}
+
+void read_lock(rwlock_t *rw) {
+    preempt_disable_at(__builtin_return_address(0));
+    while(1) {
+        spin_lock(&rw->lock);
+        if(!rw->writer) {
+            rw->readers++;
+            spin_unlock(&rw->lock);
+            return;
+        }
+        spin_unlock(&rw->lock);
+        while(rw->writer)
+            smp_poll();
+    }
+}
+
+void read_unlock(rwlock_t *rw) {
+    spin_lock(&rw->lock);
+    rw->readers--;
+    spin_unlock(&rw->lock);
+    preempt_enable_at(__builtin_return_address(0), 1);
+}
+
+void write_lock(rwlock_t *rw) {
+    preempt_disable_at(__builtin_return_address(0));
+    while(1) {
+        spin_lock(&rw->lock);
+        if(!rw->writer && (rw->readers == 0)) {
+            rw->writer = 1;
+            spin_unlock(&rw->lock);
+            return;
+        }
+        spin_unlock(&rw->lock);
+        while(rw->writer || rw->readers)
+            smp_poll();
+    }
+}
+
+void write_unlock(rwlock_t *rw) {
+    spin_lock(&rw->lock);
+    rw->writer = 0;
+    spin_unlock(&rw->lock);
+    preempt_enable_at(__builtin_return_address(0), 1);
+}
@@ -15,100 +15,1119 @@
  */
 
 #include <proc/sched.h>
+#include <proc/spinlock.h>
+#include <proc/pid.h>
 #include <console.h>
 #include <mm/memory.h>
 #include <hal/hal.h>
 #include <lib/string.h>
+#include <lib/math.h>
 #include <drivers/io.h>
 #include <panic.h>
 #include <lib/system_calls.h>
+#include <hal/vdso.h>
+#include <hal/latency.h>
+#include <proc/preempt.h>
 
-process_t *list;
+extern void yield_int();
+
+static process_t *list;
+static process_t idle_proc;
+static thread_t idle_threads[MAX_CPUS];
+static runqueue_t runqueues[MAX_CPUS];
 static int n_proc = 1;
 
+// Protects the run queues of every CPU and the process list
+static spinlock_t sched_lock = SPINLOCK_INIT;
+
+#define this_rq()       (&runqueues[smp_cpu_id()])
+#define cpu_rq(cpu)     (&runqueues[(cpu)])
+#define proc_rq(proc)   (&runqueues[(proc)->cpu])
+
+// Runnable in either class
+#define thread_on_rq(thread)    ((thread)->se.on_rq || (thread)->rt.on_rq)
+
+// Position of cs in the frame built by pit_int and yield_int
+#define FRAME_CS        12
+
 process_t *get_cur_proc() {
-    return list;
+    thread_t *cur = get_cur_thread();
+    if(cur == NULL)
+        return NULL;
+    return (process_t *) cur->parent;
+}
+
+thread_t *get_cur_thread() {
+    return this_rq()->current;
 }
 
 process_t *get_proc_by_id(int id) {
-    process_t *app = list;
-    for(int i = 0; i < n_proc; i++) {
-        thread_t *thr_app = app->thread_list;
-        for(int j = 0; j < app->threads; j++) {
-            if(thr_app->pid == id) {
-                return app;
-            }
-            thr_app = thr_app->next;
-        }
-        app = app->next;
-    }
-    return NULL;
+    thread_t *thread = get_thread_by_id(id);
+    if(thread == NULL)
+        return NULL;
+    return (process_t *) thread->parent;
+}
+
+thread_t *get_thread_by_id(int id) {
+    return pid_lookup(id);
 }
 
 void main_proc() {
+    // The console and the screen refresh are interactive, they preempt the programs
+    sched_setscheduler(0, SCHED_RR, 5);
+    start_kernel_proc("reaper", &proc_reaper);
+    start_kernel_proc("loader", &proc_loader);
     if(is_text_mode()) {
         console_init("Hoho");
     } else {
-        start_kernel_proc("draw_thread", &refresh_screen);
+        int pid = start_kernel_proc("draw_thread", &refresh_screen);
+        sched_setscheduler(pid, SCHED_FIFO, 10);
         console_init_gui("Hoho");
     }
 }
 
-uint32_t schedule(uint32_t esp) {
-    // Check if the time slice ended
-    if(get_tick_count() <= list->thread_list->time)
+/**
+ * Initializes the scheduling data of a new process
+ */
+void sched_init_proc(process_t *proc, int nice) {
+    fair_init_entity(&proc->se, (void *) proc, nice);
+    fair_init_timeline(&proc->timeline);
+    wait_queue_init(&proc->wait);
+    mutex_init(&proc->heap_lock);
+    proc->thread_slots = 0;
+    proc->io = NULL;
+    proc->image = NULL;
+    mutex_init(&proc->image_lock);
+    proc->ppid = 0;
+    proc->vdso = 0;
+    proc->parent = NULL;
+    proc->children = NULL;
+    proc->sibling = NULL;
+    proc->reap_next = NULL;
+    proc->reaped = 0;
+    proc->exit_code = 0;
+    proc->child_events = 0;
+    wait_queue_init(&proc->child_wait);
+    proc->cpu = 0;
+    proc->affinity = SCHED_ALL_CPUS;
+}
+
+/**
+ * Wakes up a thread blocked in sched_sleep
+ */
+static void sched_sleep_expired(void *data) {
+    sched_wake((thread_t *) data);
+}
+
+/**
+ * Initializes the scheduling data of a thread
+ */
+void sched_init_thread(thread_t *thread, int nice) {
+    fair_init_entity(&thread->se, (void *) thread, nice);
+    rt_init_entity(&thread->rt, (void *) thread);
+    ktimer_init(&thread->sleep_timer, &sched_sleep_expired, (void *) thread);
+    thread->waiting_on = NULL;
+    thread->wait_next = NULL;
+    thread->wait_key = 0;
+    thread->fpu_state = NULL;
+    thread->slot = -1;
+    memset(&thread->stats, 0, sizeof(thread_stats_t));
+    thread->stats.last_cpu = -1;
+    thread->joined = 0;
+}
+
+/**
+ * The slice of the scheduling period the thread gets, first the process
+ * gets its part and then its threads divide it
+ */
+uint64_t sched_slice(thread_t *thread) {
+    process_t *proc = (process_t *) thread->parent;
+    runqueue_t *rq = proc_rq(proc);
+    uint64_t period = SCHED_LATENCY_NS;
+    
+    // Too many threads to fit the latency, stretch the period
+    if(rq->nr_running > SCHED_LATENCY_NS / SCHED_MIN_GRAN_NS)
+        period = (uint64_t) rq->nr_running * SCHED_MIN_GRAN_NS;
+    
+    uint64_t slice = fair_slice(&rq->timeline, &proc->se, period);
+    slice = fair_slice(&proc->timeline, &thread->se, slice);
+    if(slice < SCHED_MIN_GRAN_NS)
+        slice = SCHED_MIN_GRAN_NS;
+    return slice;
+}
+
+/**
+ * Asks a CPU to reschedule. Locally the timer fires right away instead of
+ * waiting for the end of the slice, another CPU gets an interrupt.
+ */
+static void sched_resched(runqueue_t *rq) {
+    rq->need_resched = 1;
+    if(rq->cpu == smp_cpu_id())
+        timer_arm(0);
+    else
+        smp_send_resched(rq->cpu);
+}
+
+/**
+ * Tells if the process may run on the CPU. The kernel processes share the
+ * screen and the drivers, they stay on the bootstrap processor.
+ */
+static int sched_allowed(process_t *proc, int cpu) {
+    if(!(proc->affinity & (1 << cpu)))
+        return 0;
+    return (cpu == 0) || (proc->pdir != get_kern_directory());
+}
+
+/**
+ * The allowed CPU with the fewest processes
+ */
+static int sched_best_cpu(process_t *proc) {
+    int best = -1;
+    for(int i = 0; i < smp_ncpus(); i++) {
+        if(!sched_allowed(proc, i))
+            continue;
+        if((best == -1) || (cpu_rq(i)->nr_procs < cpu_rq(best)->nr_procs))
+            best = i;
+    }
+    return (best == -1) ? proc->cpu : best;
+}
+
+/**
+ * Tells if the CPU of the process might still be using the stack of one
+ * of its threads
+ */
+static int sched_on_cpu(process_t *proc) {
+    runqueue_t *rq = proc_rq(proc);
+    if((rq->current != NULL) && (rq->current->parent == (void *) proc))
+        return 1;
+    return (rq->last != NULL) && (rq->last->parent == (void *) proc);
+}
+
+/**
+ * Wakes up an idle CPU so it can steal work from rq
+ */
+static void sched_kick_idle(runqueue_t *rq) {
+    for(int i = 0; i < smp_ncpus(); i++) {
+        runqueue_t *app = cpu_rq(i);
+        if((app != rq) && (app->current == app->idle) && (app->nr_running == 0)) {
+            sched_resched(app);
+            return;
+        }
+    }
+}
+
+/**
+ * Makes a real-time thread runnable, it waits only for the real-time
+ * threads of higher or equal priority
+ */
+static void enqueue_rt(runqueue_t *rq, thread_t *thread) {
+    rt_enqueue(&rq->rt, &thread->rt);
+    thread->stats.wait_start = clock_now();
+    rq->nr_running++;
+    
+    thread_t *cur = rq->current;
+    if((cur == NULL) || (cur == thread) || rq->rt.throttled)
+        return;
+    if(!thread_on_rq(cur) || rt_preempt(&cur->rt, &thread->rt))
+        sched_resched(rq);
+}
+
+/**
+ * Makes a thread runnable, the scheduler lock must be held
+ */
+static void enqueue_thread(thread_t *thread) {
+    process_t *proc = (process_t *) thread->parent;
+    runqueue_t *rq = proc_rq(proc);
+    if(thread_on_rq(thread))
+        return;
+    if(thread->rt.policy != SCHED_OTHER) {
+        enqueue_rt(rq, thread);
+        return;
+    }
+    
+    // A thread that never ran is placed after the waiting ones
+    int initial = (thread->se.sum_exec == 0);
+    fair_enqueue(&proc->timeline, &thread->se, initial);
+    // The process is leaving the CPU, it's queued where it lands
+    if(rq->push == proc)
+        return;
+    thread->stats.wait_start = clock_now();
+    // First runnable thread, the process competes with the others again
+    if(proc->timeline.nr_running == 1)
+        fair_enqueue(&rq->timeline, &proc->se, initial);
+    rq->nr_running++;
+    if(rq->nr_running > 1)
+        sched_kick_idle(rq);
+    
+    // Preempt the current thread if the new one ran a lot less
+    thread_t *cur = rq->current;
+    if((cur == NULL) || (cur == thread))
+        return;
+    // A real-time thread leaves the CPU only when it's throttled
+    if(cur->rt.on_rq)
+        return;
+    process_t *cur_proc = (process_t *) cur->parent;
+    if(!cur->se.on_rq) {
+        sched_resched(rq);
+    } else if(cur_proc == proc) {
+        if(fair_wakeup_preempt(&cur->se, &thread->se))
+            sched_resched(rq);
+    } else if(fair_wakeup_preempt(&cur_proc->se, &proc->se)) {
+        sched_resched(rq);
+    }
+}
+
+/**
+ * Removes a thread from the run queue, the scheduler lock must be held
+ */
+static void dequeue_thread(thread_t *thread) {
+    process_t *proc = (process_t *) thread->parent;
+    runqueue_t *rq = proc_rq(proc);
+    if(thread->rt.on_rq) {
+        rt_dequeue(&rq->rt, &thread->rt);
+        rq->nr_running--;
+        if(thread == rq->current)
+            rq->need_resched = 1;
+        return;
+    }
+    if(!thread->se.on_rq)
+        return;
+    
+    fair_dequeue(&proc->timeline, &thread->se);
+    if(rq->push == proc)
+        return;
+    if(proc->timeline.nr_running == 0)
+        fair_dequeue(&rq->timeline, &proc->se);
+    rq->nr_running--;
+    if(thread == rq->current)
+        rq->need_resched = 1;
+}
+
+/**
+ * Makes a thread runnable
+ */
+void sched_enqueue(thread_t *thread) {
+    int flags = spin_lock_irqsave(&sched_lock);
+    enqueue_thread(thread);
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/**
+ * Removes a thread from the run queue
+ */
+void sched_dequeue(thread_t *thread) {
+    int flags = spin_lock_irqsave(&sched_lock);
+    dequeue_thread(thread);
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/**
+ * Starts a new real-time period once the last one is over, the throttled
+ * real-time threads can run again
+ */
+static void sched_rt_period(runqueue_t *rq, uint64_t now) {
+    if(now - rq->rt.period_start < RT_PERIOD_NS)
+        return;
+    rq->rt.period_start = now;
+    rq->rt.time = 0;
+    if(rq->rt.throttled) {
+        rq->rt.throttled = 0;
+        if(rq->rt.nr_running > 0)
+            rq->need_resched = 1;
+    }
+}
+
+/**
+ * Charges the time to a real-time thread. It's throttled when the real-time
+ * threads used up their runtime and fair threads are waiting.
+ */
+static void sched_tick_rt(runqueue_t *rq, thread_t *cur, uint64_t delta) {
+    cur->se.sum_exec += delta;
+    rq->rt.time += delta;
+    if(!cur->rt.on_rq) {
+        rq->need_resched = 1;
+        return;
+    }
+    
+    if((rq->rt.time >= RT_RUNTIME_NS) && (rq->nr_running > rq->rt.nr_running)) {
+        rq->rt.throttled = 1;
+        rq->need_resched = 1;
+    }
+    
+    if(cur->rt.policy != SCHED_RR)
+        return;
+    if(cur->rt.slice > delta) {
+        cur->rt.slice -= delta;
+        return;
+    }
+    // Its turn is over, the others of the same priority run first
+    cur->rt.slice = RT_RR_SLICE_NS;
+    if(cur->rt.next || cur->rt.prec) {
+        rt_requeue(&rq->rt, &cur->rt);
+        rq->need_resched = 1;
+    }
+}
+
+/**
+ * Charges the time since the last update to the running thread and its
+ * process
+ */
+static void sched_tick(runqueue_t *rq, thread_t *cur, uint64_t now, int user) {
+    process_t *proc = (process_t *) cur->parent;
+    
+    uint64_t delta = now - rq->clock;
+    rq->clock = now;
+    if(delta > TIMER_MAX_NS)
+        delta = TIMER_MAX_NS;
+    sched_rt_period(rq, now);
+    
+    // The idle thread gives the CPU away as soon as something can run
+    if(cur == rq->idle) {
+        rq->idle_time += delta;
+        if(rq->nr_running > 0)
+            rq->need_resched = 1;
+        return;
+    }
+    
+    if(user)
+        cur->stats.user_time += delta;
+    else
+        cur->stats.kernel_time += delta;
+    
+    // Real-time threads are kept out of the fair timelines
+    if(cur->rt.policy != SCHED_OTHER) {
+        sched_tick_rt(rq, cur, delta);
+        return;
+    }
+    
+    fair_update(&proc->timeline, &cur->se, (uint32_t) delta);
+    fair_update(&rq->timeline, &proc->se, (uint32_t) delta);
+    
+    // The thread was removed from the run queue, it has to leave the CPU
+    if(!cur->se.on_rq) {
+        rq->need_resched = 1;
+        return;
+    }
+    
+    if(cur->se.sum_exec - cur->se.slice_start >= sched_slice(cur))
+        rq->need_resched = 1;
+}
+
+/**
+ * Moves a process that isn't running to another CPU, the scheduler lock
+ * must be held
+ */
+static void sched_migrate(process_t *proc, runqueue_t *dst) {
+    runqueue_t *src = proc_rq(proc);
+    if(src == dst)
+        return;
+    
+    int running = proc->se.on_rq ? proc->timeline.nr_running : 0;
+    fair_migrate(&src->timeline, &dst->timeline, &proc->se);
+    
+    // The runnable real-time threads go along
+    thread_t *thread = proc->thread_list;
+    for(int i = 0; i < proc->threads; i++, thread = thread->next) {
+        if(thread->rt.on_rq) {
+            rt_dequeue(&src->rt, &thread->rt);
+            rt_enqueue(&dst->rt, &thread->rt);
+            running++;
+        }
+    }
+    
+    src->nr_running -= running;
+    src->nr_procs--;
+    proc->cpu = dst->cpu;
+    dst->nr_running += running;
+    dst->nr_procs++;
+    if(running && (dst->cpu != smp_cpu_id()))
+        sched_resched(dst);
+}
+
+/**
+ * Sends away the process that was switched out because it's not allowed
+ * on the CPU, now that the CPU left its stack
+ */
+static void sched_push(runqueue_t *rq) {
+    process_t *proc = rq->push;
+    if(proc == NULL)
+        return;
+    rq->push = NULL;
+    
+    sched_migrate(proc, cpu_rq(sched_best_cpu(proc)));
+    if(proc->timeline.nr_running > 0) {
+        runqueue_t *dst = proc_rq(proc);
+        fair_enqueue(&dst->timeline, &proc->se, 0);
+        dst->nr_running += proc->timeline.nr_running;
+        if(dst != rq)
+            sched_resched(dst);
+    }
+}
+
+/**
+ * Called when the CPU has nothing to run, takes a waiting process from the
+ * busiest CPU. Processes move as a whole, their threads share the address
+ * space and the process' part of the CPU time.
+ */
+static void sched_steal(runqueue_t *rq) {
+    runqueue_t *busiest = NULL;
+    for(int i = 0; i < smp_ncpus(); i++) {
+        runqueue_t *app = cpu_rq(i);
+        if((app == rq) || (app->nr_running < 2))
+            continue;
+        if((busiest == NULL) || (app->nr_running > busiest->nr_running))
+            busiest = app;
+    }
+    if(busiest == NULL)
+        return;
+    
+    process_t *proc = list;
+    for(int i = 0; i < n_proc; i++, proc = proc->next) {
+        if((proc->cpu != busiest->cpu) || !proc->se.on_rq || (busiest->push == proc))
+            continue;
+        if(sched_allowed(proc, rq->cpu) && !sched_on_cpu(proc)) {
+            sched_migrate(proc, rq);
+            return;
+        }
+    }
+}
+
+/**
+ * The real-time thread with the highest priority, skipping the ones of a
+ * process that's leaving the CPU
+ */
+static thread_t *sched_pick_rt(runqueue_t *rq) {
+    rt_entity_t *rt = rt_next(&rq->rt, NULL);
+    while((rt != NULL) && (((thread_t *) rt->owner)->parent == (void *) rq->push))
+        rt = rt_next(&rq->rt, rt);
+    return rt ? (thread_t *) rt->owner : NULL;
+}
+
+/**
+ * Puts the previous thread back in the timelines and picks the real-time
+ * thread with the highest priority, or the process that ran the least and
+ * then its thread that ran the least. The idle thread runs when there's
+ * nothing else.
+ */
+static thread_t *sched_pick_next(runqueue_t *rq, thread_t *prev, int voluntary) {
+    process_t *prev_proc = (process_t *) prev->parent;
+    fair_put(&prev_proc->timeline, &prev->se);
+    fair_put(&rq->timeline, &prev_proc->se);
+    // A real-time thread that yields goes after the others of its priority
+    if(voluntary && prev->rt.on_rq)
+        rt_requeue(&rq->rt, &prev->rt);
+    
+    // The affinity changed while it ran, it leaves once the CPU is off its stack
+    if((prev != rq->idle) && prev_proc->se.on_rq && (rq->push == NULL) &&
+       !sched_allowed(prev_proc, rq->cpu)) {
+        fair_dequeue(&rq->timeline, &prev_proc->se);
+        rq->nr_running -= prev_proc->timeline.nr_running;
+        rq->push = prev_proc;
+    }
+    
+    // The waiting processes that aren't allowed here can leave right away
+    sched_entity_t *se;
+    while(((se = rq->timeline.first) != NULL) && !sched_allowed((process_t *) se->owner, rq->cpu)) {
+        int cpu = sched_best_cpu((process_t *) se->owner);
+        if(cpu == rq->cpu)
+            break;
+        sched_migrate((process_t *) se->owner, cpu_rq(cpu));
+    }
+    
+    thread_t *next;
+    if(!rq->rt.throttled && ((next = sched_pick_rt(rq)) != NULL))
+        return next;
+    
+    se = fair_pick(&rq->timeline);
+    if(se == NULL) {
+        sched_steal(rq);
+        se = fair_pick(&rq->timeline);
+    }
+    if(se == NULL) {
+        // Throttled but nothing else wants the CPU
+        next = sched_pick_rt(rq);
+        return next ? next : rq->idle;
+    }
+    process_t *proc = (process_t *) se->owner;
+    se = fair_pick(&proc->timeline);
+    return (thread_t *) se->owner;
+}
+
+/**
+ * Counts the switch in the statistics of both threads
+ */
+static void sched_account_switch(runqueue_t *rq, thread_t *prev, thread_t *next, int voluntary) {
+    if(prev != rq->idle) {
+        if(voluntary || !thread_on_rq(prev))
+            prev->stats.nvcsw++;
+        else
+            prev->stats.nivcsw++;
+        // Preempted, it waits in the run queue from now
+        if(thread_on_rq(prev))
+            prev->stats.wait_start = rq->clock;
+    }
+    if(next != rq->idle) {
+        if(rq->clock > next->stats.wait_start)
+            next->stats.wait_time += rq->clock - next->stats.wait_start;
+        next->stats.last_cpu = rq->cpu;
+    }
+}
+
+/**
+ * Changes context to the next thread, returns its kernel stack pointer
+ */
+static uint32_t sched_next(runqueue_t *rq, thread_t *prev, uint32_t esp, int voluntary) {
+    rq->need_resched = 0;
+    
+    thread_t *next = sched_pick_next(rq, prev, voluntary);
+    if(next == prev)
         return esp;
     
-    reset_tick_count();
+    sched_account_switch(rq, prev, next, voluntary);
+    fpu_switch(prev);
+    // An interrupts-off window of prev doesn't continue in next
+    latency_cancel(LATENCY_IRQ);
+    rq->last = prev;
+    rq->current = next;
+    set_esp0(next->stack_kernel_limit);
+    change_page_directory(((process_t *) next->parent)->pdir);
+    vdso_switch(next);
+    
+    return next->esp_kernel;
+}
+
+/**
+ * Arms the timer for the end of the running thread's slice or for the
+ * first kernel timer, whichever comes first. With a deferred switch only
+ * the kernel timers matter, preempt_enable does the switch.
+ */
+static void sched_arm(runqueue_t *rq, thread_t *cur, int deferred) {
+    uint64_t delta = TIMER_MAX_NS;
+    if(deferred)
+        goto ktimers;
+    
+    // A thread alone on the CPU doesn't need to be preempted
+    if(cur->rt.on_rq) {
+        if((cur->rt.policy == SCHED_RR) && (rq->nr_running > 1))
+            delta = cur->rt.slice;
+        // Throttled once the runtime is over if fair threads are waiting
+        if(rq->nr_running > rq->rt.nr_running) {
+            uint64_t left = (rq->rt.time < RT_RUNTIME_NS) ? RT_RUNTIME_NS - rq->rt.time : 0;
+            if(left < delta)
+                delta = left;
+        }
+    } else if((cur != rq->idle) && (rq->nr_running > 1)) {
+        uint64_t ran = cur->se.sum_exec - cur->se.slice_start;
+        uint64_t slice = sched_slice(cur);
+        delta = (ran < slice) ? slice - ran : 0;
+    }
+    
+    // The throttled real-time threads come back with the next period
+    if(rq->rt.throttled) {
+        uint64_t end = rq->rt.period_start + RT_PERIOD_NS;
+        uint64_t wait = (end > rq->clock) ? end - rq->clock : 0;
+        if(wait < delta)
+            delta = wait;
+    }
+    
+    // A process is waiting to leave the CPU
+    if(rq->push != NULL)
+        delta = 0;
+    
+ktimers:;
+    uint64_t next = ktimer_next();
+    if(next != KTIMER_NONE) {
+        uint64_t wait = (next > rq->clock) ? next - rq->clock : 0;
+        if(wait < delta)
+            delta = wait;
+    }
+    
+    timer_arm(delta);
+}
+
+/**
+ * Runs the expired kernel timers and charges the running thread, the
+ * timers take the scheduler lock themselves
+ */
+static uint32_t sched_update(uint32_t esp, int force, int voluntary) {
+    runqueue_t *rq = this_rq();
+    thread_t *prev = rq->current;
     
     // Save the stack pointer
-    list->thread_list->esp_kernel = esp;
+    prev->esp_kernel = esp;
+    int user = (((uint32_t *) esp)[FRAME_CS] & 3) == 3;
+    // Kernel code in a critical section is switched out when it leaves it
+    int preemptible = user || (preempt_count() == 0);
+    
+    uint64_t now = clock_now();
+    ktimer_run(now);
+    if(rq->cpu == 0)
+        vdso_update(now);
+    
+    spin_lock(&sched_lock);
+    // The CPU is on the stack of the current thread now
+    rq->last = NULL;
+    sched_push(rq);
+    sched_tick(rq, prev, now, user);
+    if(force || (rq->need_resched && preemptible))
+        esp = sched_next(rq, prev, esp, voluntary);
+    
+    sched_arm(rq, rq->current, rq->need_resched);
+    spin_unlock(&sched_lock);
+    return esp;
+}
+
+/**
+ * Called by the timer interrupt
+ */
+uint32_t schedule(uint32_t esp) {
+    // The scheduler isn't running on this CPU yet
+    if(get_cur_thread() == NULL)
+        return esp;
+    return sched_update(esp, 0, 0);
+}
+
+/**
+ * Called by yield_int when the running thread gives up the CPU or when
+ * sched_preempt switches it out
+ */
+uint32_t sched_switch(uint32_t esp) {
+    runqueue_t *rq = this_rq();
+    int voluntary = !rq->preempting;
+    rq->preempting = 0;
+    return sched_update(esp, 1, voluntary);
+}
+
+/**
+ * Called by preempt_enable when the CPU left its last critical section,
+ * switches if a reschedule was deferred meanwhile
+ */
+void sched_preempt() {
+    int flags = disable_int_save();
+    runqueue_t *rq = this_rq();
+    // int works with the interrupts off, the thread can't move before it
+    if((rq->current != NULL) && rq->need_resched) {
+        rq->preempting = 1;
+        asm volatile("int %0" : : "i" (SCHED_YIELD_INT));
+    }
+    restore_int(flags);
+}
+
+/**
+ * Leaves the CPU if the calling thread is still PROC_BLOCKED, someone
+ * else already woke it up otherwise
+ */
+void sched_block() {
+    int flags = disable_int_save();
+    thread_t *cur = get_cur_thread();
+    
+    // The scheduler isn't running yet, just wait for the next interrupt
+    if(cur == NULL) {
+        asm volatile("sti; hlt; cli");
+        restore_int(flags);
+        return;
+    }
+    
+    spin_lock(&sched_lock);
+    int blocked = (cur->state == PROC_BLOCKED);
+    if(blocked)
+        dequeue_thread(cur);
+    spin_unlock(&sched_lock);
+    if(blocked)
+        sched_yield();
+    restore_int(flags);
+}
+
+/**
+ * Makes a PROC_BLOCKED thread runnable again on its CPU
+ */
+void sched_wake(thread_t *thread) {
+    int flags = spin_lock_irqsave(&sched_lock);
+    if(thread->state == PROC_BLOCKED) {
+        thread->state = PROC_ACTIVE;
+        enqueue_thread(thread);
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/**
+ * Blocks the calling thread for at least ns nanoseconds
+ */
+void sched_sleep(uint64_t ns) {
+    uint64_t wakeup = clock_now() + ns;
+    thread_t *cur = get_cur_thread();
+    
+    // The scheduler isn't running, wait for the timer interrupts
+    if(cur == NULL) {
+        int flags = disable_int_save();
+        while(clock_now() < wakeup)
+            asm volatile("sti; hlt; cli");
+        restore_int(flags);
+        return;
+    }
+    
+    cur->state = PROC_BLOCKED;
+    ktimer_add(&cur->sleep_timer, wakeup);
+    sched_block();
+}
+
+/**
+ * Takes a thread off the CPU for good
+ */
+void sched_stop_thread(thread_t *thread) {
+    int flags = spin_lock_irqsave(&sched_lock);
+    thread->state = PROC_STOPPED;
+    dequeue_thread(thread);
+    spin_unlock_irqrestore(&sched_lock, flags);
     
-    // Change thread for the next run
-    list->thread_list = list->thread_list->next;
+    ktimer_del(&thread->sleep_timer);
+    wait_cancel(thread);
+}
+
+/**
+ * Fills stats with the statistics of up to max threads, returns how many
+ */
+int sched_getstats(struct sched_stats *stats, int max) {
+    int n = 0;
+    int flags = spin_lock_irqsave(&sched_lock);
+    process_t *app = list;
+    for(int i = 0; (i < n_proc) && (n < max); i++) {
+        thread_t *thread = app->thread_list;
+        for(int j = 0; (j < app->threads) && (n < max); j++) {
+            stats[n].pid = thread->pid;
+            strncpy(stats[n].name, app->name, 15);
+            stats[n].name[15] = 0;
+            stats[n].state = thread->state;
+            stats[n].nice = thread->se.nice;
+            stats[n].policy = thread->rt.policy;
+            stats[n].rt_priority = thread->rt.prio;
+            stats[n].last_cpu = thread->stats.last_cpu;
+            stats[n].nvcsw = thread->stats.nvcsw;
+            stats[n].nivcsw = thread->stats.nivcsw;
+            stats[n].user_time = thread->stats.user_time;
+            stats[n].kernel_time = thread->stats.kernel_time;
+            stats[n].wait_time = thread->stats.wait_time;
+            n++;
+            thread = thread->next;
+        }
+        app = app->next;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return n;
+}
+
+/**
+ * Time the CPUs spent in their idle thread, in ns
+ */
+uint64_t sched_idle_time() {
+    uint64_t idle = 0;
+    for(int i = 0; i < smp_ncpus(); i++)
+        idle += cpu_rq(i)->idle_time;
+    return idle;
+}
+
+/**
+ * Gives up the CPU, a blocked thread won't come back until it's woken up
+ */
+void sched_yield() {
+    if(get_cur_thread() == NULL)
+        return;
+    asm volatile("int %0" : : "i" (SCHED_YIELD_INT));
+}
+
+/**
+ * Changes the nice value of a thread, 0 means the calling thread.
+ * The nice value of the main thread is the one of the whole process.
+ */
+int sched_setpriority(int pid, int nice) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return -1;
+    process_t *proc = (process_t *) thread->parent;
+    runqueue_t *rq = proc_rq(proc);
     
-    do {
-        // Change process, make sure it's not a finished one
-        list = list->next;
-    } while(list->state == PROC_STOPPED);
-    set_esp0(list->thread_list->stack_kernel_limit);
-    change_page_directory(list->pdir);
+    int flags = spin_lock_irqsave(&sched_lock);
+    fair_reweight(&proc->timeline, &thread->se, nice);
+    if(thread->main)
+        fair_reweight(&rq->timeline, &proc->se, nice);
+    sched_resched(rq);
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+/**
+ * Moves a thread to another scheduling class, 0 means the calling thread.
+ * SCHED_FIFO and SCHED_RR take a priority from 1 to RT_PRIO_MAX - 1,
+ * SCHED_OTHER only 0.
+ */
+int sched_setscheduler(int pid, int policy, int prio) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return -1;
+    if(policy == SCHED_OTHER) {
+        if(prio != 0)
+            return -1;
+    } else if((policy == SCHED_FIFO) || (policy == SCHED_RR)) {
+        if((prio < 1) || (prio >= RT_PRIO_MAX))
+            return -1;
+    } else {
+        return -1;
+    }
+    
+    int flags = spin_lock_irqsave(&sched_lock);
+    runqueue_t *rq = proc_rq((process_t *) thread->parent);
+    // Requeued in the run queue of its new class
+    int queued = thread_on_rq(thread);
+    if(queued)
+        dequeue_thread(thread);
+    thread->rt.policy = policy;
+    thread->rt.prio = prio;
+    thread->rt.slice = RT_RR_SLICE_NS;
+    if(queued)
+        enqueue_thread(thread);
+    sched_resched(rq);
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+/**
+ * Returns the scheduling class of a thread and stores its real-time
+ * priority in prio, 0 means the calling thread
+ */
+int sched_getscheduler(int pid, int *prio) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return -1;
+    if(prio != NULL)
+        *prio = thread->rt.prio;
+    return thread->rt.policy;
+}
+
+/**
+ * Restricts the process of a thread to the CPUs in mask, 0 means the
+ * calling thread. A running process moves at its next switch.
+ */
+int sched_setaffinity(int pid, uint32_t mask) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return -1;
+    process_t *proc = (process_t *) thread->parent;
+    
+    uint32_t online = (1 << smp_ncpus()) - 1;
+    if(!(mask & online))
+        return -1;
+    if((proc->pdir == get_kern_directory()) && !(mask & 1))
+        return -1;
     
-    return list->thread_list->esp_kernel;
+    int flags = spin_lock_irqsave(&sched_lock);
+    proc->affinity = mask;
+    if(!sched_allowed(proc, proc->cpu)) {
+        if(sched_on_cpu(proc))
+            sched_resched(proc_rq(proc));
+        else
+            sched_migrate(proc, cpu_rq(sched_best_cpu(proc)));
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+/**
+ * Returns the CPUs the process of a thread may run on, 0 means the
+ * calling thread
+ */
+uint32_t sched_getaffinity(int pid) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return 0;
+    return ((process_t *) thread->parent)->affinity & ((1 << smp_ncpus()) - 1);
+}
+
+/**
+ * Returns the nice value of a thread, 0 means the calling thread
+ */
+int sched_getpriority(int pid) {
+    thread_t *thread = (pid == 0) ? get_cur_thread() : get_thread_by_id(pid);
+    if(thread == NULL)
+        return NICE_MAX + 1;
+    return thread->se.nice;
 }
 
 void sched_add_proc(process_t *proc) {
-    sched_state(0);
+    int flags = spin_lock_irqsave(&sched_lock);
+    proc->cpu = sched_best_cpu(proc);
+    proc_rq(proc)->nr_procs++;
     n_proc++;
     proc->prec = list;
     proc->next = list->next;
     proc->next->prec = proc;
     list->next = proc;
-    sched_state(1);
+    
+    thread_t *thread = proc->thread_list;
+    for(int i = 0; i < proc->threads; i++) {
+        pid_hash_add(thread);
+        if(thread->state == PROC_ACTIVE)
+            enqueue_thread(thread);
+        thread = thread->next;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
 }
 
 void sched_remove_proc(int id) {
     process_t *app = get_proc_by_id(id);
     if(app != NULL) {
+        int flags = spin_lock_irqsave(&sched_lock);
         app->prec->next = app->next;
         app->next->prec = app->prec;
+        proc_rq(app)->nr_procs--;
+        if(proc_rq(app)->push == app)
+            proc_rq(app)->push = NULL;
         n_proc--;
-        list = app->next;
+        if(list == app)
+            list = app->next;
+        spin_unlock_irqrestore(&sched_lock, flags);
+    }
+}
+
+/**
+ * Tells if one of the process' threads is still on its CPU, a stopped
+ * thread keeps using its stack until it's switched out
+ */
+int sched_proc_running(process_t *proc) {
+    int flags = spin_lock_irqsave(&sched_lock);
+    int running = sched_on_cpu(proc);
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return running;
+}
+
+/**
+ * Tells if a stopped thread might still be on the stack of its CPU
+ */
+int sched_thread_running(thread_t *thread) {
+    int running = 0;
+    int flags = spin_lock_irqsave(&sched_lock);
+    for(int i = 0; i < smp_ncpus(); i++) {
+        runqueue_t *rq = cpu_rq(i);
+        if((rq->current == thread) || (rq->last == thread))
+            running = 1;
     }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return running;
+}
+
+/**
+ * Takes a stopped thread out of its process, the lookups walk the
+ * thread lists under the scheduler lock
+ */
+void sched_remove_thread(thread_t *thread) {
+    process_t *proc = (process_t *) thread->parent;
+    int flags = spin_lock_irqsave(&sched_lock);
+    thread->prec->next = thread->next;
+    thread->next->prec = thread->prec;
+    if(proc->thread_list == thread)
+        proc->thread_list = thread->next;
+    proc->threads--;
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/**
+ * Halts the CPU until the next interrupt
+ */
+static void sched_idle() {
+    while(1)
+        asm volatile("sti; hlt");
+}
+
+/**
+ * Builds the idle thread of a CPU, it doesn't belong to any process and
+ * never goes in the run queue. The idle threads share idle_proc.
+ */
+static thread_t *sched_create_idle(int cpu) {
+    thread_t *idle = &idle_threads[cpu];
+    
+    if(cpu == 0) {
+        memset(&idle_proc, 0, sizeof(process_t));
+        strcpy(idle_proc.name, "idle");
+        idle_proc.pdir = get_kern_directory();
+        idle_proc.thread_list = idle;
+        idle_proc.threads = 1;
+        idle_proc.state = PROC_ACTIVE;
+        sched_init_proc(&idle_proc, NICE_MAX);
+    }
+    
+    memset(idle, 0, sizeof(thread_t));
+    sched_init_thread(idle, NICE_MAX);
+    idle->next = idle;
+    idle->prec = idle;
+    idle->main = 1;
+    idle->state = PROC_ACTIVE;
+    idle->parent = (void *) &idle_proc;
+    idle->eip = (uint32_t) &sched_idle;
+    
+    // It only runs in kernel mode, the kernel stack is enough
+    idle->stack_limit = (uint32_t) kmalloc(PAGE_SIZE);
+    idle->stack_kernel_limit = idle->stack_limit + PAGE_SIZE;
+    idle->esp = idle->stack_kernel_limit;
+    
+    uint32_t *stackp = (uint32_t *) idle->stack_kernel_limit;
+    *--stackp = 0x10;                     // ss
+    *--stackp = idle->esp;                // esp
+    *--stackp = 0x202;                    // eflags
+    *--stackp = 0x8;                      // cs
+    *--stackp = idle->eip;                // eip
+    *--stackp = 0;                        // eax
+    *--stackp = 0;                        // ebx
+    *--stackp = 0;                        // ecx
+    *--stackp = 0;                        // edx
+    *--stackp = 0;                        // esi
+    *--stackp = 0;                        // edi
+    *--stackp = idle->stack_kernel_limit; // ebp
+    *--stackp = 0x10;                     // ds
+    *--stackp = 0x10;                     // es
+    *--stackp = 0x10;                     // fs
+    *--stackp = 0x10;                     // gs
+    idle->esp_kernel = (uint32_t) stackp;
+    
+    return idle;
+}
+
+/**
+ * Jumps to the first thread of the calling CPU, the frame on its kernel
+ * stack is the one of the timer interrupt
+ */
+static void sched_start(thread_t *thread) {
+    change_page_directory(((process_t *) thread->parent)->pdir);
+    set_esp0(thread->stack_kernel_limit);
+    
+    asm volatile("mov %%eax, %%esp" : : "a" (thread->esp_kernel));
+    asm volatile("pop %gs;          \
+                  pop %fs;          \
+                  pop %es;          \
+                  pop %ds;          \
+                  pop %ebp;         \
+                  pop %edi;         \
+                  pop %esi;         \
+                  pop %eax;         \
+                  pop %ebx;         \
+                  pop %ecx;         \
+                  pop %edx;         \
+                  iret");
 }
 
 void sched_init() {
-    memcpy((void *) RETURN_ADDR, &end_process_return, PAGE_SIZE);
+    // The rest of the page holds the system call entry point
+    memcpy((void *) RETURN_ADDR, &end_process_return, SYSCALL_STUB_OFFSET);
     
     process_t *proc = (process_t *) kmalloc(sizeof(process_t));
     strcpy(proc->name, "console");
     thread_t *main_thread = (thread_t *) kmalloc(sizeof(thread_t));
     proc->thread_list = main_thread;
     proc->threads = 1;
-    main_thread->time = 10;
+    sched_init_proc(proc, NICE_DEFAULT);
+    sched_init_thread(main_thread, NICE_DEFAULT);
     main_thread->next = main_thread;
     main_thread->prec = main_thread;
-    main_thread->pid = 1;
+    main_thread->pid = pid_alloc();
+    proc->pid = main_thread->pid;
     main_thread->main = 1;
     main_thread->state = PROC_ACTIVE;
     main_thread->parent = (void *) proc;
@@ -148,24 +1167,49 @@ void sched_init() {
     proc->prec = proc;
     proc->state = PROC_ACTIVE;
     list = proc;
+    pid_hash_add(main_thread);
+    
+    install_ir(SCHED_YIELD_INT, 0x80 | 0x0E, 0x8, &yield_int);
+    
+    for(int i = 0; i < MAX_CPUS; i++) {
+        runqueue_t *rq = cpu_rq(i);
+        memset(rq, 0, sizeof(runqueue_t));
+        rq->cpu = i;
+        fair_init_timeline(&rq->timeline);
+        rt_init_queue(&rq->rt);
+    }
+    
+    runqueue_t *rq = cpu_rq(0);
+    rq->clock = clock_now();
+    rq->idle = sched_create_idle(0);
+    proc->cpu = 0;
+    rq->nr_procs = 1;
+    sched_enqueue(main_thread);
+    sched_pick_next(rq, main_thread, 0);
+    
+    // The other CPUs wait in their idle thread until the scheduler is on
+    smp_init();
+    
+    // From now on the timer interrupt schedules on this CPU
     disable_int();
-    sched_state(1);
-    change_page_directory(proc->pdir);
-    set_esp0(main_thread->stack_kernel_limit);
+    rq->current = main_thread;
+    preempt_start();
+    sched_start(main_thread);
+}
+
+/**
+ * Called by an application processor once it's up, it starts running its
+ * idle thread and then the processes placed on it
+ */
+void sched_init_ap() {
+    int cpu = smp_cpu_id();
+    runqueue_t *rq = cpu_rq(cpu);
     
-    asm volatile("mov %%eax, %%esp" : : "a" (main_thread->esp_kernel));
-    asm volatile("pop %gs;          \
-                  pop %fs;          \
-                  pop %es;          \
-                  pop %ds;          \
-                  pop %ebp;         \
-                  pop %edi;         \
-                  pop %esi;         \
-                  pop %eax;         \
-                  pop %ebx;         \
-                  pop %ecx;         \
-                  pop %edx;         \
-                  iret");
+    rq->idle = sched_create_idle(cpu);
+    rq->clock = clock_now();
+    rq->current = rq->idle;
+    preempt_start();
+    sched_start(rq->idle);
 }
 
 int get_nproc() {
@@ -175,9 +1219,11 @@ int get_nproc() {
 void print_procs() {
     process_t *app = list;
     for(int i = 0; i < n_proc; i++) {
-        console_print("Name: %s id: %d page directory: 0x%x state: %d\n", app->name, app->thread_list->pid, app->pdir, app->state);
+        console_print("Name: %s id: %d page directory: 0x%x state: %d nice: %d\n", app->name, app->thread_list->pid, app->pdir, app->state, app->thread_list->se.nice);
         console_print("    eip: 0x%x esp: 0x%x stack limit: 0x%x\nimage base: 0x%x image size: %x\n\n", app->thread_list->eip, app->thread_list->esp, app->thread_list->stack_limit, app->thread_list->image_base, app->thread_list->image_size);
         app = app->next;
     }
+    uint32_t rem;
+    console_print("Idle time: %d ms on %d CPUs\n", (uint32_t) div64(sched_idle_time(), 1000000, &rem), smp_ncpus());
 }
 
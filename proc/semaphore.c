@@ -0,0 +1,54 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/semaphore.h>
+#include <proc/sched.h>
+
+void sem_init(semaphore_t *sem, int count) {
+    spin_init(&sem->lock);
+    sem->count = count;
+    wait_queue_init(&sem->wait);
+}
+
+/**
+ * Decrements the count if it's positive, returns 1 on success
+ */
+int sem_trydown(semaphore_t *sem) {
+    int flags = spin_lock_irqsave(&sem->lock);
+    int ret = (sem->count > 0);
+    if(ret)
+        sem->count--;
+    spin_unlock_irqrestore(&sem->lock, flags);
+    return ret;
+}
+
+/**
+ * Blocks until the count is positive and decrements it
+ */
+void sem_down(semaphore_t *sem) {
+    wait_event(&sem->wait, sem_trydown(sem));
+}
+
+/**
+ * Increments the count and wakes up a waiting thread, it can be called
+ * from interrupt handlers
+ */
+void sem_up(semaphore_t *sem) {
+    int flags = spin_lock_irqsave(&sem->lock);
+    sem->count++;
+    spin_unlock_irqrestore(&sem->lock, flags);
+    wake_up(&sem->wait);
+}
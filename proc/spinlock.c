@@ -0,0 +1,88 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/spinlock.h>
+#include <proc/preempt.h>
+#include <hal/smp.h>
+#include <drivers/io.h>
+
+/*
+ * The holder of a spinlock can't be preempted, a thread spinning on the
+ * same CPU would wait for a whole slice
+ */
+
+void spin_init(spinlock_t *lock) {
+    lock->locked = 0;
+}
+
+static int spin_raw_trylock(spinlock_t *lock) {
+    uint32_t old = 1;
+    asm volatile("xchg %0, %1" : "+r" (old), "+m" (lock->locked) : : "memory");
+    return old == 0;
+}
+
+static void spin_acquire(spinlock_t *lock, void *site) {
+    preempt_disable_at(site);
+    while(!spin_raw_trylock(lock)) {
+        // The owner may be waiting for this CPU to flush its TLB
+        while(lock->locked)
+            smp_poll();
+    }
+}
+
+static void spin_release(spinlock_t *lock) {
+    asm volatile("" : : : "memory");
+    lock->locked = 0;
+}
+
+/**
+ * Takes the lock if it's free, returns 1 on success
+ */
+int spin_trylock(spinlock_t *lock) {
+    preempt_disable_at(__builtin_return_address(0));
+    if(spin_raw_trylock(lock))
+        return 1;
+    preempt_enable_at(__builtin_return_address(0), 0);
+    return 0;
+}
+
+void spin_lock(spinlock_t *lock) {
+    spin_acquire(lock, __builtin_return_address(0));
+}
+
+void spin_unlock(spinlock_t *lock) {
+    spin_release(lock);
+    preempt_enable_at(__builtin_return_address(0), 1);
+}
+
+/**
+ * Disables the interrupts and takes the lock, returns the old flags
+ */
+int spin_lock_irqsave(spinlock_t *lock) {
+    int flags = disable_int_save_at(__builtin_return_address(0));
+    spin_acquire(lock, __builtin_return_address(0));
+    return flags;
+}
+
+/**
+ * Releases the lock and restores the interrupts before a pending
+ * preemption can happen
+ */
+void spin_unlock_irqrestore(spinlock_t *lock, int flags) {
+    spin_release(lock);
+    restore_int_at(flags, __builtin_return_address(0));
+    preempt_enable_at(__builtin_return_address(0), 1);
+}
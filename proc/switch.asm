@@ -0,0 +1,91 @@
+;
+;  Copyright 2016 Davide Pianca
+;
+;  Licensed under the Apache License, Version 2.0 (the "License");
+;  you may not use this file except in compliance with the License.
+;  You may obtain a copy of the License at
+;
+;      http://www.apache.org/licenses/LICENSE-2.0
+;
+;  Unless required by applicable law or agreed to in writing, software
+;  distributed under the License is distributed on an "AS IS" BASIS,
+;  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+;  See the License for the specific language governing permissions and
+;  limitations under the License.
+;
+
+extern sched_switch
+
+; Voluntary context switch, the kernel stack is built like in pit_int so
+; the thread can be resumed by either of them
+global yield_int
+yield_int:
+
+    ; push registers
+    push eax
+    push ebx
+    push ecx
+    push edx
+    push esi
+    push edi
+    push ebp
+    push ds
+    push es
+    push fs
+    push gs
+    
+    mov ebx, esp            ; save stack pointer
+    
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    
+    push ebx
+    call sched_switch       ; pick the next thread
+    
+    mov esp, eax            ; change stack pointer
+    
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    
+    pop ebp
+    pop edi
+    pop esi
+    pop edx
+    pop ecx
+    pop ebx
+    pop eax
+    iretd
+
+extern exec_finish
+
+; Leaves the address space execve replaced: loads the new page directory
+; and the kernel stack kernel_stack_fill built in it, then enters the new
+; program like a thread that's switched in
+global exec_switch
+exec_switch:
+    cli
+    mov eax, [esp + 4]      ; page directory
+    mov ebx, [esp + 8]      ; kernel stack
+    mov cr3, eax
+    mov esp, ebx
+    
+    call exec_finish        ; hand the old address space to the reaper
+    
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    
+    pop ebp
+    pop edi
+    pop esi
+    pop edx
+    pop ecx
+    pop ebx
+    pop eax
+    iretd
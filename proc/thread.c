@@ -20,79 +20,112 @@
 #include <drivers/io.h>
 #include <drivers/video.h>
 #include <proc/sched.h>
+#include <proc/pid.h>
 #include <hal/hal.h>
 #include <lib/string.h>
 
 extern void fork_eip();
 
-static int pid = 2;
-
 /* Allocates space for a new thread */
 thread_t *create_thread() {
     thread_t *thread = (thread_t *) kmalloc(sizeof(thread_t));
     if(thread == NULL)
         return NULL;
-    thread->pid = pid++;
+    thread->pid = pid_alloc();
+    if(thread->pid < 0) {
+        kfree(thread);
+        return NULL;
+    }
     thread->main = 0;
-    thread->time = 10;
+    sched_init_thread(thread, NICE_DEFAULT);
     thread->state = PROC_NEW;
     thread->next = thread;
     thread->prec = thread;
     return thread;
 }
 
+/**
+ * Lowest region after the image that no fork-style thread of the process
+ * has its stacks and heap in, the main thread is in the first one
+ */
+static int thread_region(process_t *cur, thread_t *parent) {
+    vmm_addr_t base = parent->image_base + parent->image_size;
+    for(int n = 1; ; n++) {
+        int used = 0;
+        thread_t *thread = cur->thread_list;
+        for(int i = 0; i < cur->threads; i++, thread = thread->next) {
+            if((thread->slot < 0) && (thread->stack_limit == base + (PAGE_SIZE * 6 * n) + PAGE_SIZE))
+                used = 1;
+        }
+        if(!used)
+            return n;
+    }
+}
+
 /* Starts a new thread (fork) */
 int start_thread() {
-    sched_state(0);
+    mutex_lock(&proc_lock);
     disable_int();
     process_t *cur = get_cur_proc();
     
     thread_t *thread = create_thread();
-    if(!thread)
+    if(!thread) {
+        mutex_unlock(&proc_lock);
+        enable_int();
         return -1;
+    }
     
-    thread_t *parent = cur->thread_list;
+    thread_t *parent = get_cur_thread();
+    // The threads that ended leave their region to the next ones
+    int region = thread_region(cur, parent);
     
-    thread->image_base = cur->thread_list->image_base;
-    thread->image_size = cur->thread_list->image_size;
+    thread->image_base = parent->image_base;
+    thread->image_size = parent->image_size;
     thread->parent = (void *) cur;
+    // The child inherits the parent's priority
+    sched_init_thread(thread, parent->se.nice);
     
-    if(!build_stack(thread, cur->pdir, cur->threads + 1)) {
+    if(!build_stack(thread, cur->pdir, region)) {
+        pid_free(thread->pid);
         kfree(thread);
-        sched_state(1);
+        mutex_unlock(&proc_lock);
         enable_int();
         return -1;
     }
     
     if(!stack_fill(thread, 0, 0)) {
+        pid_free(thread->pid);
         kfree(thread);
-        sched_state(1);
+        mutex_unlock(&proc_lock);
         enable_int();
         return -1;
     }
     
-    memcpy((void *) thread->stack_limit - PAGE_SIZE, (void *) cur->thread_list->stack_limit - PAGE_SIZE, PAGE_SIZE);
+    memcpy((void *) thread->stack_limit - PAGE_SIZE, (void *) parent->stack_limit - PAGE_SIZE, PAGE_SIZE);
 
-    if(!build_heap(thread, cur->pdir, cur->threads + 1)) {
+    if(!build_heap(thread, cur->pdir, region)) {
+        pid_free(thread->pid);
         kfree(thread);
-        sched_state(1);
+        mutex_unlock(&proc_lock);
         enable_int();
         return -1;
     }
-    memcpy((void *) thread->heap, (void *) cur->thread_list->heap, PAGE_SIZE);
+    memcpy((void *) thread->heap, (void *) parent->heap, PAGE_SIZE);
     
     cur->threads++;
     
-    thread->prec = cur->thread_list;
-    thread->next = cur->thread_list->next;
-    cur->thread_list->next->prec = thread;
-    cur->thread_list->next = thread;
+    thread->prec = parent;
+    thread->next = parent->next;
+    parent->next->prec = thread;
+    parent->next = thread;
     
     // TODO fix splitting
     fork_eip();
-    if(cur->thread_list == parent) {
+    if(get_cur_thread() == parent) {
+        pid_hash_add(thread);
         thread->state = PROC_ACTIVE;
-        sched_state(1);
+        sched_enqueue(thread);
+        mutex_unlock(&proc_lock);
         enable_int();
         return thread->pid;
     } else {
@@ -102,35 +135,225 @@ int start_thread() {
 
 /* Terminates the calling thread */
 void stop_thread(int code) {
-    sched_state(0);
-
     process_t *cur = get_cur_proc();
     if(cur == NULL) {
         console_print("Process not found\n");
-        sched_state(1);
         enable_int();
         while(1);
     }
     
+    thread_t *thread = get_cur_thread();
+    
     // Terminating the main thread will terminate the process
-    if(cur->thread_list->main == 1)
+    if(thread->main == 1)
         end_proc(code);
     
-    thread_t *thread = cur->thread_list;
+    /*
+     * The thread is still running on its kernel stack, now that the TLB
+     * is flushed on unmap it can't free it. thread_join frees the slot
+     * threads, the reaper the others once they are off their CPU.
+     */
+    thread->exit_code = code;
+    if(thread->slot < 0)
+        proc_reap_thread(thread);
+    sched_stop_thread(thread);
+    wake_up_all(&cur->wait);
     
-    cur->thread_list->next->prec = cur->thread_list->prec;
-    cur->thread_list->prec->next = cur->thread_list->next;
+    enable_int();
+    while(1)
+        sched_yield();
+}
+
+/**
+ * Maps the user and kernel stacks of a slot thread in the current
+ * address space
+ */
+static int thread_map_stack(thread_t *thread, page_dir_t *pdir, uint32_t stack_size) {
+    thread->stack_kernel_limit = THREAD_SLOTS_START + (thread->slot + 1) * THREAD_SLOT_SIZE;
+    thread->stack_limit = thread->stack_kernel_limit - PAGE_SIZE;
+    thread->stack_base = thread->stack_limit - stack_size;
     
-    vmm_unmap(cur->pdir, cur->thread_list->stack_limit - PAGE_SIZE);
-    vmm_unmap(cur->pdir, cur->thread_list->stack_kernel_limit - PAGE_SIZE);
-    for(int i = 0; i < 4; i++) {
-        vmm_unmap(cur->pdir, cur->thread_list->heap + (i * PAGE_SIZE));
+    // The page table must be reachable from user mode
+    if(!pdir[thread->stack_base >> 22] && !vmm_create_page_table(pdir, thread->stack_base, PAGE_PRESENT | PAGE_RW | PAGE_USER))
+        return 0;
+    for(uint32_t addr = thread->stack_base; addr < thread->stack_limit; addr += PAGE_SIZE) {
+        if(!vmm_map(pdir, addr, PAGE_PRESENT | PAGE_RW | PAGE_USER))
+            return 0;
     }
-    
+    return vmm_map(pdir, thread->stack_limit, PAGE_PRESENT | PAGE_RW);
+}
+
+/**
+ * Frees the stacks, the slot and the thread itself, the thread must be
+ * off its CPU
+ */
+void thread_free(thread_t *thread, page_dir_t *pdir) {
+    process_t *proc = (process_t *) thread->parent;
+    for(uint32_t addr = thread->stack_base; addr < thread->stack_kernel_limit; addr += PAGE_SIZE) {
+        if(get_phys_addr(pdir, addr))
+            vmm_unmap(pdir, addr);
+    }
+    proc->thread_slots &= ~(1 << thread->slot);
+    pid_hash_remove(thread);
+    pid_free(thread->pid);
+    fpu_free(thread);
     kfree(thread);
+}
+
+/**
+ * Makes a slot thread of the calling process with its stacks mapped,
+ * proc_lock must be held
+ */
+static thread_t *thread_alloc(process_t *proc, thread_t *parent, uint32_t stack_size) {
+    int slot = 0;
+    while((slot < THREAD_MAX_SLOTS) && (proc->thread_slots & (1 << slot)))
+        slot++;
+    thread_t *thread = (slot < THREAD_MAX_SLOTS) ? create_thread() : NULL;
+    if(thread == NULL)
+        return NULL;
     
-    sched_state(1);
-    enable_int();
-    while(1);
+    thread->parent = (void *) proc;
+    thread->image_base = parent->image_base;
+    thread->image_size = parent->image_size;
+    thread->heap = parent->heap;
+    thread->heap_limit = parent->heap_limit;
+    // The new thread inherits the creator's priority
+    sched_init_thread(thread, parent->se.nice);
+    thread->slot = slot;
+    proc->thread_slots |= 1 << slot;
+    
+    if(!thread_map_stack(thread, proc->pdir, stack_size)) {
+        thread_free(thread, proc->pdir);
+        return NULL;
+    }
+    return thread;
+}
+
+/**
+ * Links a new thread after parent and makes it runnable, proc_lock must
+ * be held
+ */
+static void thread_publish(process_t *proc, thread_t *parent, thread_t *thread) {
+    thread->prec = parent;
+    thread->next = parent->next;
+    parent->next->prec = thread;
+    parent->next = thread;
+    proc->threads++;
+    pid_hash_add(thread);
+    
+    thread->state = PROC_ACTIVE;
+    sched_enqueue(thread);
 }
 
+/**
+ * Starts a thread of the calling process at start(entry, arg) on a new
+ * stack of stack_size bytes, 0 for the default. start must never return,
+ * it ends the thread with exit. Returns the thread id.
+ */
+int thread_create_sys(void *start, void *entry, void *arg, uint32_t stack_size) {
+    process_t *proc = get_cur_proc();
+    thread_t *parent = get_cur_thread();
+    if((proc == NULL) || (start == NULL) || (proc->pdir == get_kern_directory()))
+        return -1;
+    
+    if(stack_size == 0)
+        stack_size = THREAD_STACK_DEFAULT;
+    stack_size = (stack_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if(stack_size > THREAD_STACK_MAX)
+        return -1;
+    
+    mutex_lock(&proc_lock);
+    thread_t *thread = thread_alloc(proc, parent, stack_size);
+    if(thread == NULL) {
+        mutex_unlock(&proc_lock);
+        return -1;
+    }
+    
+    // The address space is the current one, the stacks are reachable
+    uint32_t *stackp = (uint32_t *) thread->stack_limit;
+    *--stackp = (uint32_t) arg;
+    *--stackp = (uint32_t) entry;
+    *--stackp = 0;                          // start never returns
+    thread->esp = (uint32_t) stackp;
+    thread->eip = (uint32_t) start;
+    kernel_stack_fill(thread);
+    
+    thread_publish(proc, parent, thread);
+    mutex_unlock(&proc_lock);
+    return thread->pid;
+}
+
+/**
+ * Starts a thread of the calling process running func in kernel mode on
+ * its kernel stack, it sees the address space of the process
+ */
+thread_t *thread_create_kernel(void (*func)()) {
+    process_t *proc = get_cur_proc();
+    thread_t *parent = get_cur_thread();
+    if(proc == NULL)
+        return NULL;
+    
+    mutex_lock(&proc_lock);
+    thread_t *thread = thread_alloc(proc, parent, 0);
+    if(thread == NULL) {
+        mutex_unlock(&proc_lock);
+        return NULL;
+    }
+    
+    thread->eip = (uint32_t) func;
+    thread->esp = thread->stack_kernel_limit;
+    uint32_t *stackp = (uint32_t *) thread->stack_kernel_limit;
+    *--stackp = 0x10;                       // ss
+    *--stackp = thread->esp;                // esp
+    *--stackp = 0x202;                      // eflags
+    *--stackp = 0x8;                        // cs
+    *--stackp = thread->eip;                // eip
+    *--stackp = 0;                          // eax
+    *--stackp = 0;                          // ebx
+    *--stackp = 0;                          // ecx
+    *--stackp = 0;                          // edx
+    *--stackp = 0;                          // esi
+    *--stackp = 0;                          // edi
+    *--stackp = thread->stack_kernel_limit; // ebp
+    *--stackp = 0x10;                       // ds
+    *--stackp = 0x10;                       // es
+    *--stackp = 0x10;                       // fs
+    *--stackp = 0x10;                       // gs
+    thread->esp_kernel = (uint32_t) stackp;
+    
+    thread_publish(proc, parent, thread);
+    mutex_unlock(&proc_lock);
+    return thread;
+}
+
+/**
+ * Waits for a thread of the calling process made by thread_create to
+ * end, stores its exit code in ret and frees it
+ */
+int thread_join_sys(int tid, int *ret) {
+    process_t *proc = get_cur_proc();
+    thread_t *thread = get_thread_by_id(tid);
+    if((thread == NULL) || (thread->parent != (void *) proc) || (thread == get_cur_thread()) || (thread->slot < 0))
+        return -1;
+    
+    mutex_lock(&proc_lock);
+    if(thread->joined) {
+        mutex_unlock(&proc_lock);
+        return -1;
+    }
+    thread->joined = 1;
+    mutex_unlock(&proc_lock);
+    
+    wait_event(&proc->wait, thread->state == PROC_STOPPED);
+    while(sched_thread_running(thread))
+        sched_yield();
+    
+    if(ret != NULL)
+        *ret = thread->exit_code;
+    
+    mutex_lock(&proc_lock);
+    sched_remove_thread(thread);
+    thread_free(thread, proc->pdir);
+    mutex_unlock(&proc_lock);
+    return 0;
+}
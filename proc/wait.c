@@ -0,0 +1,159 @@
+/*
+ *  Copyright 2016 Davide Pianca
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <proc/wait.h>
+#include <proc/proc.h>
+#include <proc/sched.h>
+#include <drivers/io.h>
+
+void wait_queue_init(wait_queue_t *queue) {
+    spin_init(&queue->lock);
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+/**
+ * Removes the thread from its queue, the queue lock must be held
+ */
+static void wait_unlink(wait_queue_t *queue, thread_t *thread) {
+    thread_t **pos = &queue->head;
+    thread_t *prev = NULL;
+    while((*pos != NULL) && (*pos != thread)) {
+        prev = *pos;
+        pos = &(*pos)->wait_next;
+    }
+    if(*pos == NULL)
+        return;
+    *pos = thread->wait_next;
+    if(queue->tail == thread)
+        queue->tail = prev;
+    thread->wait_next = NULL;
+    thread->waiting_on = NULL;
+}
+
+/**
+ * Queues the calling thread and marks it as blocked, it keeps running
+ * until sched_block
+ */
+void prepare_to_wait(wait_queue_t *queue) {
+    thread_t *cur = get_cur_thread();
+    if(cur == NULL)
+        return;
+    
+    int flags = spin_lock_irqsave(&queue->lock);
+    if(cur->waiting_on != queue) {
+        cur->wait_next = NULL;
+        cur->waiting_on = queue;
+        if(queue->tail)
+            queue->tail->wait_next = cur;
+        else
+            queue->head = cur;
+        queue->tail = cur;
+    }
+    cur->state = PROC_BLOCKED;
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/**
+ * Leaves the queue once the condition is true
+ */
+void finish_wait(wait_queue_t *queue) {
+    thread_t *cur = get_cur_thread();
+    if(cur == NULL)
+        return;
+    
+    int flags = spin_lock_irqsave(&queue->lock);
+    if(cur->waiting_on == queue)
+        wait_unlink(queue, cur);
+    cur->state = PROC_ACTIVE;
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/**
+ * Takes a stopped thread out of the queue it's sleeping on
+ */
+void wait_cancel(thread_t *thread) {
+    wait_queue_t *queue = thread->waiting_on;
+    if(queue == NULL)
+        return;
+    
+    int flags = spin_lock_irqsave(&queue->lock);
+    if(thread->waiting_on == queue)
+        wait_unlink(queue, thread);
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/**
+ * Blocks the calling thread on the queue until it's woken up
+ */
+void sleep_on(wait_queue_t *queue) {
+    prepare_to_wait(queue);
+    sched_block();
+    finish_wait(queue);
+}
+
+/**
+ * Wakes up the first thread waiting on the queue
+ */
+void wake_up(wait_queue_t *queue) {
+    int flags = spin_lock_irqsave(&queue->lock);
+    thread_t *thread = queue->head;
+    if(thread)
+        wait_unlink(queue, thread);
+    spin_unlock_irqrestore(&queue->lock, flags);
+    
+    if(thread)
+        sched_wake(thread);
+}
+
+/**
+ * Wakes up all the threads waiting on the queue
+ */
+void wake_up_all(wait_queue_t *queue) {
+    int flags = spin_lock_irqsave(&queue->lock);
+    thread_t *thread = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    while(thread) {
+        thread_t *next = thread->wait_next;
+        thread->wait_next = NULL;
+        thread->waiting_on = NULL;
+        sched_wake(thread);
+        thread = next;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/**
+ * Wakes up at most nr threads waiting on the queue for key, for queues
+ * shared by many events. Returns how many were woken up
+ */
+int wake_up_key(wait_queue_t *queue, uint32_t key, int nr) {
+    int woken = 0;
+    int flags = spin_lock_irqsave(&queue->lock);
+    thread_t *thread = queue->head;
+    while(thread && (woken < nr)) {
+        thread_t *next = thread->wait_next;
+        if(thread->wait_key == key) {
+            wait_unlink(queue, thread);
+            sched_wake(thread);
+            woken++;
+        }
+        thread = next;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return woken;
+}